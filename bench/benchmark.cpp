@@ -1,8 +1,24 @@
 #define D_ITERATOR_UNIT_TEST
+#include "../include/arena.h"
 #include "../include/array.h"
+#include "../include/fd_reader.h"
+#include "../include/group_by.h"
 #include "../include/iterator.h"
+#include "../include/join.h"
+#include "../include/merge.h"
+#include "../include/mapped_file.h"
+#include "../include/parallel.h"
+#include "../include/text.h"
+#include "../include/top_k.h"
+#include "../include/window.h"
 
+#include <algorithm>
 #include <benchmark/benchmark.h>
+#include <cstring>
+#include <numeric>
+#include <queue>
+#include <random>
+#include <unordered_map>
 
 static void BM_count_if(benchmark::State &s) {
 	int arr[1000];
@@ -19,6 +35,165 @@ static void BM_count_if(benchmark::State &s) {
 
 BENCHMARK(BM_count_if);
 
+// Arg 0 is the number of threads, the serial count is the baseline.
+static void BM_parallel_count_if(benchmark::State &s) {
+	const uint64     len = 1 << 24;
+	std::vector<int> arr(len);
+	for (uint64 i = 0; i < len; i++) { arr[i] = int(i); }
+
+	for ([[maybe_unused]] auto _: s) {
+		uint64 count = algo::parallel_count(
+				it::filter(it::iterator(arr.data(), len), [](int i) { return i % 2 == 0; }),
+				s.range(0));
+
+		benchmark::DoNotOptimize(std::move(count));
+	}
+	s.SetItemsProcessed(int64(s.iterations() * len));
+}
+
+BENCHMARK(BM_parallel_count_if)->RangeMultiplier(2)->Range(1, algo::default_threads())->UseRealTime();
+
+template<bool use_blocks>
+static void BM_filter_map_sum(benchmark::State &s) {
+	const uint64 size = s.range(0);
+
+	// pseudo random data, so the filter can't be predicted
+	int *arr = new int[size];
+	for (uint64 i = 0; i < size; i++) { arr[i] = int((i * 2654435761U) >> 8 & 0xFFFF); }
+
+	for ([[maybe_unused]] auto _: s) {
+		auto it = it::iterator(arr, size) | it::filter([](int i) { return i % 3 != 0; })
+				| it::map([](int i) { return int64(i) * 3; }) | it::take(size - 1);
+		int64 sum = 0;
+		if constexpr (use_blocks) {
+			sum = algo::sum(it);
+		} else {
+			while (it.has_next()) {
+				sum += *it;
+				++it;
+			}
+		}
+		benchmark::DoNotOptimize(std::move(sum));
+		benchmark::DoNotOptimize(std::move(arr));
+	}
+	delete[] arr;
+}
+
+BENCHMARK(BM_filter_map_sum<false>)->Arg(1000)->Arg(10000000);
+BENCHMARK(BM_filter_map_sum<true>)->Arg(1000)->Arg(10000000);
+
+enum class FilterConsumer { Count, Sum, MapSum };
+
+// Sweeps the selectivity of a filter over random data, from 1% to 99% of the elements passing.
+// The scalar versions step through the filter one element at a time.
+// Count sums the selection vectors, Sum zeros the rejected elements and MapSum compacts the blocks.
+template<bool use_blocks, FilterConsumer C>
+static void BM_filter_selectivity(benchmark::State &s) {
+	const uint64 size        = 1 << 20;
+	const int    selectivity = int(s.range(0));
+
+	int *arr = new int[size];
+	for (uint64 i = 0; i < size; i++) { arr[i] = int(((i * 2654435761U) >> 8) % 100); }
+
+	for ([[maybe_unused]] auto _: s) {
+		auto it = it::iterator(arr, size)
+				| it::filter([selectivity](int i) { return i < selectivity; });
+		auto mapped = it | it::map([](int i) { return int64(i) * 3; });
+		int64 result = 0;
+		if constexpr (use_blocks && C == FilterConsumer::Count) {
+			result = int64(algo::count(it));
+		} else if constexpr (use_blocks && C == FilterConsumer::Sum) {
+			result = algo::sum<int64>(it);
+		} else if constexpr (use_blocks) {
+			result = algo::sum(mapped);
+		} else if constexpr (C == FilterConsumer::MapSum) {
+			while (mapped.has_next()) {
+				result += *mapped;
+				++mapped;
+			}
+		} else {
+			while (it.has_next()) {
+				result += C == FilterConsumer::Sum ? *it : 1;
+				++it;
+			}
+		}
+		benchmark::DoNotOptimize(std::move(result));
+		benchmark::DoNotOptimize(std::move(arr));
+	}
+	delete[] arr;
+}
+
+#define SELECTIVITY_SWEEP Arg(1)->Arg(10)->Arg(25)->Arg(50)->Arg(75)->Arg(90)->Arg(99)
+BENCHMARK(BM_filter_selectivity<false, FilterConsumer::Count>)->SELECTIVITY_SWEEP;
+BENCHMARK(BM_filter_selectivity<true, FilterConsumer::Count>)->SELECTIVITY_SWEEP;
+BENCHMARK(BM_filter_selectivity<false, FilterConsumer::Sum>)->SELECTIVITY_SWEEP;
+BENCHMARK(BM_filter_selectivity<true, FilterConsumer::Sum>)->SELECTIVITY_SWEEP;
+BENCHMARK(BM_filter_selectivity<false, FilterConsumer::MapSum>)->SELECTIVITY_SWEEP;
+BENCHMARK(BM_filter_selectivity<true, FilterConsumer::MapSum>)->SELECTIVITY_SWEEP;
+#undef SELECTIVITY_SWEEP
+
+enum class Reduction { Sum, Min, Max, MinMax, ArgMin };
+
+// The scalar versions are plain folds, the simd versions use the kernels in simd.h.
+template<class T, Reduction R, bool use_simd>
+static void BM_reduction(benchmark::State &s) {
+	const uint64 size = s.range(0);
+
+	T *arr = new T[size];
+	for (uint64 i = 0; i < size; i++) { arr[i] = T((i * 2654435761U) >> 8 & 0xFFFF); }
+
+	for ([[maybe_unused]] auto _: s) {
+		const auto it = it::iterator(arr, size);
+		if constexpr (R == Reduction::Sum && use_simd) {
+			benchmark::DoNotOptimize(algo::sum<T>(it));
+		} else if constexpr (R == Reduction::Sum) {
+			benchmark::DoNotOptimize(it | algo::reduce(T(0), [](T a, T b) { return a + b; }));
+		} else if constexpr (R == Reduction::Min && use_simd) {
+			benchmark::DoNotOptimize(algo::min(it));
+		} else if constexpr (R == Reduction::Min) {
+			benchmark::DoNotOptimize(it | algo::reduce(arr[0], [](T a, T b) { return it::min(a, b); }));
+		} else if constexpr (R == Reduction::Max && use_simd) {
+			benchmark::DoNotOptimize(algo::max(it));
+		} else if constexpr (R == Reduction::Max) {
+			benchmark::DoNotOptimize(it | algo::reduce(arr[0], [](T a, T b) { return it::max(a, b); }));
+		} else if constexpr (R == Reduction::MinMax && use_simd) {
+			benchmark::DoNotOptimize(algo::minmax(it));
+		} else if constexpr (R == Reduction::MinMax) {
+			T lo = arr[0];
+			T hi = arr[0];
+			for (const T e: it) {
+				lo = it::min(lo, e);
+				hi = it::max(hi, e);
+			}
+			benchmark::DoNotOptimize(lo);
+			benchmark::DoNotOptimize(hi);
+		} else if constexpr (R == Reduction::ArgMin && use_simd) {
+			benchmark::DoNotOptimize(algo::argmin(it));
+		} else {
+			uint64 best = 0;
+			for (uint64 i = 1; i < size; i++) {
+				if (arr[i] < arr[best]) { best = i; }
+			}
+			benchmark::DoNotOptimize(best);
+		}
+		benchmark::ClobberMemory();
+	}
+	delete[] arr;
+}
+
+BENCHMARK(BM_reduction<int32, Reduction::Sum, false>)->Arg(1 << 10)->Arg(1 << 22);
+BENCHMARK(BM_reduction<int32, Reduction::Sum, true>)->Arg(1 << 10)->Arg(1 << 22);
+BENCHMARK(BM_reduction<float64, Reduction::Sum, false>)->Arg(1 << 10)->Arg(1 << 22);
+BENCHMARK(BM_reduction<float64, Reduction::Sum, true>)->Arg(1 << 10)->Arg(1 << 22);
+BENCHMARK(BM_reduction<int32, Reduction::Min, false>)->Arg(1 << 10)->Arg(1 << 22);
+BENCHMARK(BM_reduction<int32, Reduction::Min, true>)->Arg(1 << 10)->Arg(1 << 22);
+BENCHMARK(BM_reduction<float64, Reduction::Max, false>)->Arg(1 << 10)->Arg(1 << 22);
+BENCHMARK(BM_reduction<float64, Reduction::Max, true>)->Arg(1 << 10)->Arg(1 << 22);
+BENCHMARK(BM_reduction<int32, Reduction::MinMax, false>)->Arg(1 << 10)->Arg(1 << 22);
+BENCHMARK(BM_reduction<int32, Reduction::MinMax, true>)->Arg(1 << 10)->Arg(1 << 22);
+BENCHMARK(BM_reduction<float32, Reduction::ArgMin, false>)->Arg(1 << 10)->Arg(1 << 22);
+BENCHMARK(BM_reduction<float32, Reduction::ArgMin, true>)->Arg(1 << 10)->Arg(1 << 22);
+
 uint64 count_pairs(int *arr) {
 	const auto it = it::iterator(arr, 1000);
 
@@ -86,6 +261,20 @@ uint64 count_pairs_naive2(int *arr) {
 	return count;
 }
 
+// count_pairs_better, split by the number of pairs.
+uint64 count_pairs_parallel(int *arr, uint64 len, uint64 threads) {
+	return it::unordered_pairs(it::iterator(arr, len)) //
+		 | it::map([](auto p) {
+			   struct pair_t {
+				   int first;
+				   int second;
+			   };
+			   return pair_t{max(p.first, p.second) + 5, min(p.first, p.second)};
+		   })
+		 | it::filter([](auto p) { return p.first * p.second >= 4900; })
+		 | it::filter([](auto p) { return p.first * p.second <= 4964; })
+		 | algo::parallel_count(threads);
+}
 
 template<auto VERSION>
 static void BM_count_pairs(benchmark::State &s) {
@@ -118,6 +307,623 @@ static void BM_skip(benchmark::State &s) {
 	delete[] arr;
 }
 
+// Arg 0 is the offset of the page, random access skips it in O(1), the linear version increments offset times.
+template<bool random_access>
+static void BM_pagination(benchmark::State &s) {
+	const uint64     len = 1 << 12;
+	std::vector<int> rows(len);
+	for (uint64 i = 0; i < len; i++) { rows[i] = int(i); }
+
+	for ([[maybe_unused]] auto _: s) {
+		auto page = it::unordered_pairs(it::iterator(rows.data(), len));
+		if constexpr (random_access) {
+			page = page | it::skip(uint64(s.range(0)));
+		} else {
+			for (int64 i = 0; i < s.range(0); i++) { ++page; }
+		}
+		int64 sum = page | it::take(100) | it::map([](auto p) { return int64(p.first) * p.second; })
+				  | algo::sum<int64>();
+
+		benchmark::DoNotOptimize(std::move(sum));
+	}
+}
+BENCHMARK(BM_pagination<false>)->Arg(1000)->Arg(1000000);
+BENCHMARK(BM_pagination<true>)->Arg(1000)->Arg(1000000);
+
+// An all-pairs equality join of 64 probe keys against s.range(0) keys, the untiled version streams the keys once per probe.
+template<bool tiled>
+static void BM_pairs_tiled(benchmark::State &s) {
+	std::vector<int64> keys(s.range(0));
+	std::vector<int64> probes(64);
+	for (uint64 i = 0; i < keys.size(); i++) { keys[i] = int64(i * 7919 % 100003); }
+	for (uint64 i = 0; i < probes.size(); i++) { probes[i] = int64(i * 104729 % 100003); }
+	const auto key_it   = it::iterator(keys.data(), keys.size());
+	const auto probe_it = it::iterator(probes.data(), probes.size());
+
+	for ([[maybe_unused]] auto _: s) {
+		const auto equal = [](auto p) { return p.first == p.second; };
+		uint64     count;
+		if constexpr (tiled) {
+			count = algo::count(it::cross_product_tiled(key_it, probe_it) | it::filter(equal));
+		} else {
+			count = algo::count(it::cross_product(key_it, probe_it) | it::filter(equal));
+		}
+
+		benchmark::DoNotOptimize(std::move(count));
+	}
+	s.SetItemsProcessed(int64(s.iterations()) * s.range(0) * 64);
+}
+BENCHMARK(BM_pairs_tiled<false>)->RangeMultiplier(16)->Range(1 << 12, 1 << 22);
+BENCHMARK(BM_pairs_tiled<true>)->RangeMultiplier(16)->Range(1 << 12, 1 << 22);
+
+// A request that materializes a filtered and a mapped intermediate result, into vectors or into an arena reset per request.
+template<bool use_arena>
+static void BM_collect(benchmark::State &s) {
+	std::vector<int> rows(s.range(0));
+	for (uint64 i = 0; i < rows.size(); i++) { rows[i] = int(i * 7919 % 1000); }
+	const auto it = it::iterator(rows.data(), rows.size());
+
+	arena a;
+	for ([[maybe_unused]] auto _: s) {
+		int64 sum;
+		if constexpr (use_arena) {
+			const auto selected = it | it::filter([](int e) { return e < 500; }) | algo::collect_into(a);
+			const auto scaled   = selected | it::map([](int e) { return int64(e) * 3; }) | algo::collect_into(a);
+			sum                 = algo::sum(scaled);
+			a.reset();
+		} else {
+			auto selected = algo::to_array<std::vector<int>>(it | it::filter([](int e) { return e < 500; }));
+			auto scaled   = algo::to_array<std::vector<int64>>(it::iterator(selected.data(), selected.size())
+															   | it::map([](int e) { return int64(e) * 3; }));
+			sum           = algo::sum(it::iterator(scaled.data(), scaled.size()));
+		}
+
+		benchmark::DoNotOptimize(std::move(sum));
+	}
+}
+BENCHMARK(BM_collect<false>)->RangeMultiplier(16)->Range(16, 1 << 16);
+BENCHMARK(BM_collect<true>)->RangeMultiplier(16)->Range(16, 1 << 16);
+
+// A file of s.range(0) int64 records, written once per size.
+static const char *record_file(uint64 records) {
+	static std::string path;
+	static uint64      written = 0;
+	if (written != records) {
+		path = "/tmp/d_iterator_bench_" + std::to_string(records);
+		std::vector<int64> data(records);
+		for (uint64 i = 0; i < records; i++) { data[i] = int64(i * 7919 % 1000); }
+		std::FILE *file = std::fopen(path.c_str(), "wb");
+		std::fwrite(data.data(), sizeof(int64), records, file);
+		std::fclose(file);
+		written = records;
+	}
+	return path.c_str();
+}
+
+// False if the file can't be opened or ends before data is full.
+static bool read_records(const char *path, std::vector<int64> &data) {
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) { return false; }
+	const uint64 size = data.size() * sizeof(int64);
+	uint64       done = 0;
+	while (done < size) {
+		const auto n = read(fd, reinterpret_cast<char *>(data.data()) + done, size - done);
+		if (n <= 0) { break; }
+		done += uint64(n);
+	}
+	close(fd);
+	return done == size;
+}
+
+// The whole file is scanned, read() copies it into a heap buffer first, mapped_file scans the page cache in place.
+template<bool mapped>
+static void BM_file_scan(benchmark::State &s) {
+	const char *path = record_file(s.range(0));
+	for ([[maybe_unused]] auto _: s) {
+		int64 sum;
+		if constexpr (mapped) {
+			const it::mapped_file<int64> file(path);
+			sum = algo::sum(file.to_iterator());
+		} else {
+			std::vector<int64> data(s.range(0));
+			if (!read_records(path, data)) {
+				s.SkipWithError("read failed");
+				break;
+			}
+			sum = algo::sum(it::iterator(data.data(), data.size()));
+		}
+		benchmark::DoNotOptimize(std::move(sum));
+	}
+	s.SetBytesProcessed(int64(s.iterations()) * s.range(0) * int64(sizeof(int64)));
+}
+BENCHMARK(BM_file_scan<false>)->RangeMultiplier(8)->Range(1 << 20, 1 << 26)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_file_scan<true>)->RangeMultiplier(8)->Range(1 << 20, 1 << 26)->Unit(benchmark::kMillisecond);
+
+// Time to the first record, it grows with the file size for read() but not for the mapping.
+template<bool mapped>
+static void BM_file_open(benchmark::State &s) {
+	const char *path = record_file(s.range(0));
+	for ([[maybe_unused]] auto _: s) {
+		int64 first;
+		if constexpr (mapped) {
+			const it::mapped_file<int64> file(path, {.pattern = it::AccessPattern::Random});
+			first = *file.to_iterator();
+		} else {
+			std::vector<int64> data(s.range(0));
+			if (!read_records(path, data)) {
+				s.SkipWithError("read failed");
+				break;
+			}
+			first = *it::iterator(data.data(), data.size());
+		}
+		benchmark::DoNotOptimize(std::move(first));
+	}
+}
+BENCHMARK(BM_file_open<false>)->RangeMultiplier(8)->Range(1 << 20, 1 << 26)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_file_open<true>)->RangeMultiplier(8)->Range(1 << 20, 1 << 26)->Unit(benchmark::kMicrosecond);
+
+// Streams the file through two 1 MB buffers while every record is hashed, read-ahead overlaps the reads with it.
+template<bool read_ahead>
+static void BM_fd_scan(benchmark::State &s) {
+	const char *path = record_file(s.range(0));
+	for ([[maybe_unused]] auto _: s) {
+		it::fd_reader<int64> reader(path, {.read_ahead = read_ahead});
+		const uint64 hash = reader.to_iterator() | it::map([](int64 x) {
+								uint64 h = uint64(x);
+								for (int i = 0; i < 8; i++) { h = (h ^ h >> 29) * 0xBF58476D1CE4E5B9; }
+								return h;
+							})
+						  | algo::sum<uint64>();
+		benchmark::DoNotOptimize(hash);
+	}
+	s.SetBytesProcessed(int64(s.iterations()) * s.range(0) * int64(sizeof(int64)));
+}
+BENCHMARK(BM_fd_scan<false>)->RangeMultiplier(8)->Range(1 << 20, 1 << 26)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_fd_scan<true>)->RangeMultiplier(8)->Range(1 << 20, 1 << 26)->Unit(benchmark::kMillisecond);
+
+// Asks for the remaining count on every step, like a progress report, the recounting wrapper is O(n^2).
+template<it::CountMode mode>
+static void BM_counted_wrapper(benchmark::State &s) {
+	std::vector<int> arr(s.range(0));
+	for (uint64 i = 0; i < arr.size(); i++) { arr[i] = int(i); }
+
+	for ([[maybe_unused]] auto _: s) {
+		auto   counted = it::iterator(arr.data(), arr.size()) | it::filter([](int i) { return i % 3 == 0; })
+					   | it::counted_wrapper<mode>();
+		uint64 acc     = 0;
+		while (counted.has_next()) {
+			acc += counted.count();
+			++counted;
+		}
+
+		benchmark::DoNotOptimize(std::move(acc));
+	}
+	s.SetComplexityN(s.range(0));
+}
+BENCHMARK(BM_counted_wrapper<it::CountMode::Recount>)->RangeMultiplier(4)->Range(64, 16384)->Complexity();
+BENCHMARK(BM_counted_wrapper<it::CountMode::Eager>)->RangeMultiplier(4)->Range(64, 16384)->Complexity();
+BENCHMARK(BM_counted_wrapper<it::CountMode::Lazy>)->RangeMultiplier(4)->Range(64, 16384)->Complexity();
+
+enum class CStringOp { Count, Find, ToArray };
+
+// The byte at a time versions step through the iterator like before it had count and blocks.
+template<CStringOp OP, bool word_at_a_time>
+static void BM_c_string(benchmark::State &s) {
+	std::vector<char> str(s.range(0) + 1, 'x');
+	str.back() = '\0';
+
+	for ([[maybe_unused]] auto _: s) {
+		auto   it     = it::c_string_iterator(str.data());
+		uint64 result = 0;
+		if constexpr (word_at_a_time) {
+			if constexpr (OP == CStringOp::Count) { result = algo::count(it); }
+			if constexpr (OP == CStringOp::Find) { result = algo::find(it, '#'); }
+			if constexpr (OP == CStringOp::ToArray) { result = algo::to_array<std::vector<char>>(it).size(); }
+		} else {
+			std::vector<char> arr;
+			while (it.has_next()) {
+				if constexpr (OP == CStringOp::Find) {
+					if (*it == '#') { break; }
+				}
+				if constexpr (OP == CStringOp::ToArray) { arr.push_back(*it); }
+				result++;
+				++it;
+			}
+			result += arr.size();
+		}
+		benchmark::DoNotOptimize(std::move(result));
+	}
+	s.SetBytesProcessed(int64(s.iterations() * s.range(0)));
+}
+BENCHMARK(BM_c_string<CStringOp::Count, false>)->Arg(64)->Arg(4096)->Arg(1 << 20);
+BENCHMARK(BM_c_string<CStringOp::Count, true>)->Arg(64)->Arg(4096)->Arg(1 << 20);
+BENCHMARK(BM_c_string<CStringOp::Find, false>)->Arg(64)->Arg(4096)->Arg(1 << 20);
+BENCHMARK(BM_c_string<CStringOp::Find, true>)->Arg(64)->Arg(4096)->Arg(1 << 20);
+BENCHMARK(BM_c_string<CStringOp::ToArray, false>)->Arg(64)->Arg(4096)->Arg(1 << 20);
+BENCHMARK(BM_c_string<CStringOp::ToArray, true>)->Arg(64)->Arg(4096)->Arg(1 << 20);
+
+enum class IndexPattern { Sequential, Strided, Shuffled };
+
+// Every element of base is loaded once through an index array, distance 0 is the plain map without prefetching.
+template<IndexPattern pattern, uint64 distance>
+static void BM_gather(benchmark::State &s) {
+	const uint64        n = s.range(0);
+	std::vector<int64>  base(n);
+	std::vector<uint32> indices(n);
+	for (uint64 i = 0; i < n; i++) {
+		base[i]    = int64(i * 7919 % 1000);
+		indices[i] = uint32(i);
+	}
+	if constexpr (pattern == IndexPattern::Strided) {
+		// 16 elements are 128 bytes, so consecutive loads hit different cache lines.
+		for (uint64 i = 0; i < n; i++) { indices[i] = uint32(i % (n / 16) * 16 + i / (n / 16)); }
+	}
+	if constexpr (pattern == IndexPattern::Shuffled) {
+		std::shuffle(indices.begin(), indices.end(), std::mt19937_64(42));
+	}
+
+	for ([[maybe_unused]] auto _: s) {
+		const auto source = it::iterator(indices.data(), indices.size());
+		int64      sum;
+		if constexpr (distance == 0) {
+			sum = source | it::map([&base](uint32 i) { return base[i]; }) | algo::sum<int64>();
+		} else {
+			sum = source | it::gather<distance>(base.data()) | algo::sum<int64>();
+		}
+		benchmark::DoNotOptimize(std::move(sum));
+	}
+	s.SetItemsProcessed(int64(s.iterations() * n));
+	s.SetBytesProcessed(int64(s.iterations() * n * sizeof(int64)));
+}
+// 32 KB to 256 MB of base elements, from L1 to DRAM.
+#define GATHER_SIZES RangeMultiplier(8)->Range(1 << 12, 1 << 25)
+BENCHMARK(BM_gather<IndexPattern::Sequential, 0>)->GATHER_SIZES;
+BENCHMARK(BM_gather<IndexPattern::Sequential, 64>)->GATHER_SIZES;
+BENCHMARK(BM_gather<IndexPattern::Strided, 0>)->GATHER_SIZES;
+BENCHMARK(BM_gather<IndexPattern::Strided, 16>)->GATHER_SIZES;
+BENCHMARK(BM_gather<IndexPattern::Strided, 64>)->GATHER_SIZES;
+BENCHMARK(BM_gather<IndexPattern::Shuffled, 0>)->GATHER_SIZES;
+BENCHMARK(BM_gather<IndexPattern::Shuffled, 16>)->GATHER_SIZES;
+BENCHMARK(BM_gather<IndexPattern::Shuffled, 64>)->GATHER_SIZES;
+
+enum class TopK { SortAll, PartialSort, Heap, ParallelHeap };
+
+// The 100 largest of random values, sorting a copy of everything against the streaming heap.
+template<TopK mode>
+static void BM_top_k(benchmark::State &s) {
+	std::vector<int64> values(s.range(0));
+	std::mt19937_64    rng(42);
+	for (auto &e: values) { e = int64(rng() >> 1); }
+	const auto source = it::iterator(values.data(), values.size());
+
+	for ([[maybe_unused]] auto _: s) {
+		int64 smallest_kept;
+		if constexpr (mode == TopK::SortAll) {
+			auto copy = algo::to_array<std::vector<int64>>(source);
+			std::sort(copy.begin(), copy.end(), std::greater<>());
+			smallest_kept = copy[99];
+		}
+		if constexpr (mode == TopK::PartialSort) {
+			auto copy = algo::to_array<std::vector<int64>>(source);
+			std::partial_sort(copy.begin(), copy.begin() + 100, copy.end(), std::greater<>());
+			smallest_kept = copy[99];
+		}
+		if constexpr (mode == TopK::Heap) { smallest_kept = (source | algo::top_k<100>())[99]; }
+		if constexpr (mode == TopK::ParallelHeap) { smallest_kept = (source | algo::parallel_top_k<100>())[99]; }
+		benchmark::DoNotOptimize(std::move(smallest_kept));
+	}
+	s.SetItemsProcessed(int64(s.iterations()) * s.range(0));
+}
+BENCHMARK(BM_top_k<TopK::SortAll>)->Arg(1 << 20)->Arg(1 << 24)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_top_k<TopK::PartialSort>)->Arg(1 << 20)->Arg(1 << 24)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_top_k<TopK::Heap>)->Arg(1 << 20)->Arg(1 << 24)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_top_k<TopK::ParallelHeap>)->Arg(1 << 20)->Arg(1 << 24)->Unit(benchmark::kMillisecond);
+
+enum class GroupBy { UnorderedMap, FlatTable, ParallelFlatTable };
+
+// Sums of 16M random values grouped by s.range(0) distinct keys, from a table in L1 to one in DRAM.
+template<GroupBy mode>
+static void BM_group_by(benchmark::State &s) {
+	const uint64       keys = uint64(s.range(0));
+	std::vector<int64> values(1 << 24);
+	std::mt19937_64    rng(42);
+	for (auto &e: values) { e = int64(rng() >> 1); }
+	const auto source = it::iterator(values.data(), values.size());
+	const auto key    = [keys](int64 e) { return uint64(e) % keys; };
+	const auto plus   = [](int64 a, int64 b) { return a + b; };
+	const auto sum    = algo::aggregate(int64(0), plus, plus);
+
+	arena a;
+	for ([[maybe_unused]] auto _: s) {
+		uint64 groups;
+		if constexpr (mode == GroupBy::UnorderedMap) {
+			std::unordered_map<uint64, int64> map;
+			for (const auto e: values) { map[key(e)] += e; }
+			groups = map.size();
+		}
+		if constexpr (mode == GroupBy::FlatTable) { groups = (source | algo::group_by(key, sum, a)).count(); }
+		if constexpr (mode == GroupBy::ParallelFlatTable) {
+			groups = (source | algo::parallel_group_by(key, sum, a)).count();
+		}
+		benchmark::DoNotOptimize(std::move(groups));
+		a.reset();
+	}
+	s.SetItemsProcessed(int64(s.iterations() * values.size()));
+}
+#define GROUP_BY_KEYS RangeMultiplier(32)->Range(1 << 5, 1 << 20)->Unit(benchmark::kMillisecond)
+BENCHMARK(BM_group_by<GroupBy::UnorderedMap>)->GROUP_BY_KEYS;
+BENCHMARK(BM_group_by<GroupBy::FlatTable>)->GROUP_BY_KEYS;
+BENCHMARK(BM_group_by<GroupBy::ParallelFlatTable>)->GROUP_BY_KEYS;
+
+enum class Join { UnorderedMultimap, HashJoin, SemiJoin, AntiJoin };
+enum class JoinPhase { Build, Probe };
+
+// 4M events against s.range(0) distinct ids, half of the events have a row.
+// 4K rows fit into L2, 4M rows spill to DRAM.
+// Build only builds the table, against no events. Probe builds it once and only counts the matches.
+template<Join mode, JoinPhase phase>
+static void BM_join(benchmark::State &s) {
+	struct row {
+		int64 id;
+		int64 payload;
+	};
+	const uint64       rows_n = uint64(s.range(0));
+	std::vector<row>   rows(rows_n);
+	std::vector<int64> events(1 << 22);
+	std::mt19937_64    rng(42);
+	for (uint64 i = 0; i < rows_n; i++) { rows[i] = {int64(2 * i), int64(i)}; }
+	for (auto &e: events) { e = int64(rng() % (2 * rows_n)); }
+	const auto build  = it::iterator(rows.data(), rows.size());
+	const auto probe  = it::iterator(events.data(), phase == JoinPhase::Build ? 0 : events.size());
+	const auto row_id = [](row r) { return r.id; };
+	const auto self   = [](int64 e) { return e; };
+
+	const auto make_join = [&](arena &a) {
+		if constexpr (mode == Join::SemiJoin) {
+			return probe | it::semi_join(build, row_id, self, a);
+		} else if constexpr (mode == Join::AntiJoin) {
+			return probe | it::anti_join(build, row_id, self, a);
+		} else {
+			return probe | it::hash_join(build, row_id, self, a);
+		}
+	};
+
+	if constexpr (mode == Join::UnorderedMultimap && phase == JoinPhase::Build) {
+		for ([[maybe_unused]] auto _: s) {
+			std::unordered_multimap<int64, row> built;
+			for (const auto &r: rows) { built.emplace(r.id, r); }
+			benchmark::DoNotOptimize(built.size());
+		}
+	} else if constexpr (mode == Join::UnorderedMultimap) {
+		std::unordered_multimap<int64, row> map;
+		for (const auto &r: rows) { map.emplace(r.id, r); }
+		for ([[maybe_unused]] auto _: s) {
+			uint64 matches = 0;
+			for (const auto e: events) { matches += map.count(e); }
+			benchmark::DoNotOptimize(std::move(matches));
+		}
+	} else if constexpr (phase == JoinPhase::Build) {
+		for ([[maybe_unused]] auto _: s) {
+			arena built;
+			benchmark::DoNotOptimize(algo::count(make_join(built)));
+		}
+	} else {
+		arena      a;
+		const auto joined = make_join(a);
+		for ([[maybe_unused]] auto _: s) { benchmark::DoNotOptimize(algo::count(joined)); }
+	}
+	s.SetItemsProcessed(int64(s.iterations() * (phase == JoinPhase::Build ? rows.size() : events.size())));
+}
+#define JOIN_ROWS Arg(1 << 12)->Arg(1 << 22)->Unit(benchmark::kMillisecond)
+BENCHMARK(BM_join<Join::UnorderedMultimap, JoinPhase::Build>)->JOIN_ROWS;
+BENCHMARK(BM_join<Join::HashJoin, JoinPhase::Build>)->JOIN_ROWS;
+BENCHMARK(BM_join<Join::SemiJoin, JoinPhase::Build>)->JOIN_ROWS;
+BENCHMARK(BM_join<Join::UnorderedMultimap, JoinPhase::Probe>)->JOIN_ROWS;
+BENCHMARK(BM_join<Join::HashJoin, JoinPhase::Probe>)->JOIN_ROWS;
+BENCHMARK(BM_join<Join::SemiJoin, JoinPhase::Probe>)->JOIN_ROWS;
+BENCHMARK(BM_join<Join::AntiJoin, JoinPhase::Probe>)->JOIN_ROWS;
+
+enum class Merge { Sort, StdMerge, PriorityQueue, TwoWay, LoserTree };
+
+// Folds 4M random values in sorted order from s.range(0) sorted shards, StdMerge and TwoWay only for two shards.
+template<Merge mode>
+static void BM_merge_k(benchmark::State &s) {
+	const uint64                    k = uint64(s.range(0));
+	std::vector<std::vector<int64>> shards(k);
+	std::mt19937_64                 rng(42);
+	for (auto &shard: shards) {
+		shard.resize((1 << 22) / k);
+		for (auto &e: shard) { e = int64(rng() >> 1); }
+		std::sort(shard.begin(), shard.end());
+	}
+	std::vector<it::iterator<int64>> iterators;
+	for (auto &shard: shards) { iterators.emplace_back(shard.data(), shard.size()); }
+
+	arena a;
+	for ([[maybe_unused]] auto _: s) {
+		int64 result = 0;
+		if constexpr (mode == Merge::Sort) {
+			std::vector<int64> all;
+			for (const auto &shard: shards) { all.insert(all.end(), shard.begin(), shard.end()); }
+			std::sort(all.begin(), all.end());
+			for (const auto e: all) { result = result * 31 + e; }
+		}
+		if constexpr (mode == Merge::StdMerge) {
+			std::vector<int64> all(shards[0].size() + shards[1].size());
+			std::merge(shards[0].begin(), shards[0].end(), shards[1].begin(), shards[1].end(), all.begin());
+			for (const auto e: all) { result = result * 31 + e; }
+		}
+		if constexpr (mode == Merge::PriorityQueue) {
+			using head = std::pair<int64, uint64>;
+			std::vector<uint64> pos(k);
+			std::priority_queue<head, std::vector<head>, std::greater<>> heap;
+			for (uint64 i = 0; i < k; i++) { heap.emplace(shards[i][0], i); }
+			while (!heap.empty()) {
+				const auto [e, i] = heap.top();
+				heap.pop();
+				result = result * 31 + e;
+				if (++pos[i] < shards[i].size()) { heap.emplace(shards[i][pos[i]], i); }
+			}
+		}
+		if constexpr (mode == Merge::TwoWay) {
+			result = it::merge(iterators[0], iterators[1])
+				   | algo::reduce(int64(0), [](int64 acc, int64 e) { return acc * 31 + e; });
+		}
+		if constexpr (mode == Merge::LoserTree) {
+			result = it::merge_k(array_view(iterators.data(), k), a)
+				   | algo::reduce(int64(0), [](int64 acc, int64 e) { return acc * 31 + e; });
+		}
+		benchmark::DoNotOptimize(std::move(result));
+		a.reset();
+	}
+	s.SetItemsProcessed(int64(s.iterations()) * (1 << 22));
+}
+BENCHMARK(BM_merge_k<Merge::Sort>)->Arg(2)->Arg(256)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_merge_k<Merge::StdMerge>)->Arg(2)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_merge_k<Merge::TwoWay>)->Arg(2)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_merge_k<Merge::PriorityQueue>)->Arg(2)->Arg(256)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_merge_k<Merge::LoserTree>)->Arg(2)->Arg(256)->Unit(benchmark::kMillisecond);
+
+enum class Rolling { RecomputeSum, RecomputeMax, Sum, Max };
+
+// Moving sums and maxima of 4M random values over windows of 64, recomputed per window against the rolling ones.
+template<Rolling mode>
+static void BM_rolling(benchmark::State &s) {
+	constexpr uint64   w = 64;
+	std::vector<int64> values(1 << 22);
+	std::mt19937_64    rng(42);
+	for (auto &e: values) { e = int64(rng() >> 1); }
+	const auto source = it::iterator(values.data(), values.size());
+
+	for ([[maybe_unused]] auto _: s) {
+		int64 result = 0;
+		if constexpr (mode == Rolling::RecomputeSum) {
+			for (uint64 i = 0; i + w <= values.size(); i++) {
+				result += std::accumulate(values.begin() + int64(i), values.begin() + int64(i + w), int64(0));
+			}
+		}
+		if constexpr (mode == Rolling::RecomputeMax) {
+			for (uint64 i = 0; i + w <= values.size(); i++) {
+				result += *std::max_element(values.begin() + int64(i), values.begin() + int64(i + w));
+			}
+		}
+		if constexpr (mode == Rolling::Sum) { result = algo::sum<int64>(source | it::rolling<w>(it::rolling_sum())); }
+		if constexpr (mode == Rolling::Max) { result = algo::sum<int64>(source | it::rolling<w>(it::rolling_max())); }
+		benchmark::DoNotOptimize(std::move(result));
+	}
+	s.SetItemsProcessed(int64(s.iterations() * values.size()));
+}
+BENCHMARK(BM_rolling<Rolling::RecomputeSum>)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_rolling<Rolling::RecomputeMax>)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_rolling<Rolling::Sum>)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_rolling<Rolling::Max>)->Unit(benchmark::kMillisecond);
+
+enum class Scan { StdInclusiveScan, ScanInto, ParallelScanInto, LazyScan };
+
+// Running sums of int64 into a second array, the lazy scan is summed instead of stored.
+// 16K elements stay in L1 and L2, 16M are bound by the memory bandwidth.
+template<Scan mode>
+static void BM_scan(benchmark::State &s) {
+	std::vector<int64> values(s.range(0));
+	std::vector<int64> out(values.size());
+	std::mt19937_64    rng(42);
+	for (auto &e: values) { e = int64(rng() % 1000); }
+	const auto source = it::iterator(values.data(), values.size());
+
+	for ([[maybe_unused]] auto _: s) {
+		int64 result = 0;
+		if constexpr (mode == Scan::StdInclusiveScan) {
+			std::inclusive_scan(values.begin(), values.end(), out.begin());
+			result = out.back();
+		}
+		if constexpr (mode == Scan::ScanInto) { result = algo::inclusive_scan_into(source, out.data()).total; }
+		if constexpr (mode == Scan::ParallelScanInto) {
+			result = algo::parallel_inclusive_scan_into(source, out.data()).total;
+		}
+		if constexpr (mode == Scan::LazyScan) { result = algo::sum<int64>(source | it::scan(int64(0))); }
+		benchmark::DoNotOptimize(std::move(result));
+		benchmark::ClobberMemory();
+	}
+	s.SetItemsProcessed(int64(s.iterations() * values.size()));
+}
+BENCHMARK(BM_scan<Scan::StdInclusiveScan>)->Arg(1 << 14)->Arg(1 << 24);
+BENCHMARK(BM_scan<Scan::ScanInto>)->Arg(1 << 14)->Arg(1 << 24);
+BENCHMARK(BM_scan<Scan::ParallelScanInto>)->Arg(1 << 14)->Arg(1 << 24);
+BENCHMARK(BM_scan<Scan::LazyScan>)->Arg(1 << 14)->Arg(1 << 24);
+
+enum class LineScan { ByteAtATime, Memchr, SplitLines, CountLines };
+
+// Sums the line lengths of a log with lines of 0 to 149 bytes, split_lines against a byte loop and libc memchr.
+template<LineScan scan>
+static void BM_split_lines(benchmark::State &s) {
+	std::string log;
+	for (int64 i = 0; int64(log.size()) < s.range(0); i++) {
+		log += std::string(uint64(i * 7919 % 150), 'x') + '\n';
+	}
+
+	for ([[maybe_unused]] auto _: s) {
+		uint64 result = 0;
+		if constexpr (scan == LineScan::ByteAtATime) {
+			uint64 start = 0;
+			for (uint64 i = 0; i < log.size(); i++) {
+				if (log[i] == '\n') {
+					result += i - start;
+					start = i + 1;
+				}
+			}
+		}
+		if constexpr (scan == LineScan::Memchr) {
+			for (const char *pos = log.data(), *end = log.data() + log.size(); pos < end;) {
+				const auto *next = static_cast<const char *>(std::memchr(pos, '\n', uint64(end - pos)));
+				if (next == nullptr) { next = end; }
+				result += uint64(next - pos);
+				pos = next + 1;
+			}
+		}
+		if constexpr (scan == LineScan::SplitLines) {
+			result = it::split_lines(log.data(), log.size())
+				   | it::map([](array_view<char> line) { return line.count(); }) | algo::sum<uint64>();
+		}
+		if constexpr (scan == LineScan::CountLines) { result = algo::count(it::split_lines(log.data(), log.size())); }
+		benchmark::DoNotOptimize(std::move(result));
+	}
+	s.SetBytesProcessed(int64(s.iterations()) * s.range(0));
+}
+BENCHMARK(BM_split_lines<LineScan::ByteAtATime>)->Arg(1 << 24);
+BENCHMARK(BM_split_lines<LineScan::Memchr>)->Arg(1 << 24);
+BENCHMARK(BM_split_lines<LineScan::SplitLines>)->Arg(1 << 24);
+BENCHMARK(BM_split_lines<LineScan::CountLines>)->Arg(1 << 24);
+
+enum class Erasure { Static, AnyBatched, AnyPerElement };
+
+// The same filter | map | sum, statically typed, type erased with batches and type erased element by element.
+template<Erasure E>
+static void BM_any_iterator(benchmark::State &s) {
+	std::vector<int> arr(s.range(0));
+	for (uint64 i = 0; i < arr.size(); i++) { arr[i] = int(i * 7919 % 1000); }
+
+	for ([[maybe_unused]] auto _: s) {
+		const auto pipeline = it::iterator(arr.data(), arr.size()) | it::filter([](int i) { return i < 500; })
+							| it::map([](int i) { return i * 3; });
+		int64 sum = 0;
+		if constexpr (E == Erasure::Static) { sum = algo::sum<int64>(pipeline); }
+		if constexpr (E == Erasure::AnyBatched) {
+			sum = algo::sum<int64>(it::any_iterator<int>(pipeline));
+		}
+		if constexpr (E == Erasure::AnyPerElement) {
+			for (auto erased = it::any_iterator<int>(pipeline); erased.has_next(); ++erased) {
+				sum += *erased;
+			}
+		}
+
+		benchmark::DoNotOptimize(std::move(sum));
+	}
+	s.SetItemsProcessed(int64(s.iterations() * s.range(0)));
+}
+BENCHMARK(BM_any_iterator<Erasure::Static>)->Arg(1000)->Arg(1 << 20);
+BENCHMARK(BM_any_iterator<Erasure::AnyBatched>)->Arg(1000)->Arg(1 << 20);
+BENCHMARK(BM_any_iterator<Erasure::AnyPerElement>)->Arg(1000)->Arg(1 << 20);
+
 template<bool use_cache>
 static void BM_caching_iterator(benchmark::State &s) {
 	uint64 size = 1000;
@@ -222,6 +1028,65 @@ static void BM_n_queens(benchmark::State &s) {
 	}
 }
 
+// The same search as a lazy pipeline, the solutions are produced one by one without intermediate vectors.
+template<uint64 size>
+auto backtrack_lazy(array<uint8, size> conf) {
+	if constexpr (size == 8) {
+		return it::single_element_iterator(conf);
+	} else {
+		return successors(conf)                       //
+			 | it::filter(legal<size + 1>)            //
+			 | it::flat_map(backtrack_lazy<size + 1>);
+	}
+}
+
+static void BM_n_queens_lazy(benchmark::State &s) {
+	for ([[maybe_unused]] auto _: s) {
+		std::vector<array<uint8, 8>> solutions;
+		for (const auto solution: backtrack_lazy(array<uint8, 0>{})) { solutions.push_back(solution); }
+		benchmark::DoNotOptimize(std::move(solutions));
+	}
+}
+
+static void BM_n_queens_lazy_count(benchmark::State &s) {
+	for ([[maybe_unused]] auto _: s) {
+		uint64 solutions = algo::count(backtrack_lazy(array<uint8, 0>{}));
+		benchmark::DoNotOptimize(std::move(solutions));
+	}
+}
+
+using queens = packed_array<4, 8>;
+
+// SWAR version, the new queen is checked against the whole configuration at once.
+constexpr bool legal_packed(queens conf) {
+	if (conf.size <= 1) { return true; }
+	const auto [head, tail] = conf.head_tail();
+	const auto row          = queens::broadcast(head);
+	const auto distance     = queens::iota(1);
+	return (tail.equal(row) | tail.equal(queens::add(row, distance)) | tail.equal(queens::sub(row, distance)))
+		== 0;
+}
+
+template<uint64 size>
+auto backtrack_packed(queens conf) {
+	if constexpr (size == 8) {
+		return it::single_element_iterator(conf);
+	} else {
+		return it::sequence_generator<uint8>(0, 8)                     //
+			 | it::map([conf](uint8 i) { return conf.push_front(i); }) //
+			 | it::filter(legal_packed)                                //
+			 | it::flat_map(backtrack_packed<size + 1>);
+	}
+}
+
+static void BM_n_queens_packed(benchmark::State &s) {
+	for ([[maybe_unused]] auto _: s) {
+		std::vector<queens> solutions;
+		for (const auto solution: backtrack_packed<0>(queens())) { solutions.push_back(solution); }
+		benchmark::DoNotOptimize(std::move(solutions));
+	}
+}
+
 
 constexpr auto successors_2(array_f conf) {
 	return it::sequence_generator<uint8>(0, 8) | it::map([conf](int8 i) { return i + conf; });
@@ -278,11 +1143,29 @@ BENCHMARK(BM_count_pairs<count_pairs_naive>);
 BENCHMARK(BM_count_pairs<count_pairs_naive2>);
 BENCHMARK(BM_count_pairs<count_pairs_better>);
 BENCHMARK(BM_count_pairs<count_pairs>);
+
+// Arg 0 is the number of threads, arg 1 the number of elements.
+static void BM_parallel_count_pairs(benchmark::State &s) {
+	std::vector<int> arr(s.range(1));
+	for (uint64 i = 0; i < arr.size(); i++) { arr[i] = int(i % 1000); }
+
+	for ([[maybe_unused]] auto _: s) {
+		uint64 count = count_pairs_parallel(arr.data(), arr.size(), s.range(0));
+
+		benchmark::DoNotOptimize(std::move(count));
+	}
+}
+BENCHMARK(BM_parallel_count_pairs)
+		->ArgsProduct({benchmark::CreateRange(1, int64(algo::default_threads()), 2), {1000, 10000}})
+		->UseRealTime();
 BENCHMARK(BM_caching_iterator<true>);
 BENCHMARK(BM_caching_iterator<false>);
 BENCHMARK(BM_skip);
 BENCHMARK(BM_stupid_count);
 BENCHMARK(BM_n_queens);
 BENCHMARK(BM_n_queens2);
+BENCHMARK(BM_n_queens_lazy);
+BENCHMARK(BM_n_queens_lazy_count);
+BENCHMARK(BM_n_queens_packed);
 
 BENCHMARK_MAIN();
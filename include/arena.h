@@ -0,0 +1,201 @@
+//
+// Created by af on 16/10/26.
+//
+
+#ifndef D_ITERATOR_ARENA_H
+#define D_ITERATOR_ARENA_H
+
+#include "iterator.h"
+
+#if !defined(NO_STD)
+#include <cstdlib>
+#endif
+
+/*
+ * Bump allocator for results that die together, e.g. everything a request materializes.
+ * It starts in a caller provided buffer (stack, static storage or an mmap'd region)
+ * and continues in chunks from the grow function, each at least twice as large as the previous one.
+ * reset() frees everything at once in O(1), the chunks are kept for reuse and only released by the destructor.
+ * Nothing is destructed, so only trivially copyable values belong into an arena.
+ *
+ * With NO_STD there is no default grow function, so the arena is limited to its buffer
+ * unless grow and release functions are passed. Otherwise the chunks come from malloc.
+ * A failed allocation returns nullptr and sets failed() until the next reset().
+ */
+struct arena {
+	using grow_fn    = void *(*)(uint64 bytes);
+	using release_fn = void (*)(void *chunk, uint64 bytes);
+
+#if defined(NO_STD)
+	static constexpr grow_fn    default_grow    = nullptr;
+	static constexpr release_fn default_release = nullptr;
+#else
+	static void *default_grow(uint64 bytes) { return std::malloc(bytes); }
+	static void  default_release(void *chunk, uint64) { std::free(chunk); }
+#endif
+
+	static constexpr uint64 min_chunk_size = 4096;
+
+	// Header at the start of every owned chunk, size includes it.
+	struct chunk {
+		chunk *next;
+		uint64 size;
+	};
+
+	uint8     *_buffer;
+	uint64     _buffer_size;
+	grow_fn    _grow;
+	release_fn _release;
+	chunk     *_chunks     = nullptr; // owned chunks in the order they are used
+	chunk     *_current    = nullptr; // nullptr while allocating from the buffer
+	uint8     *_pos        = nullptr;
+	uint64     _left       = 0;
+	uint64     _chunk_size = min_chunk_size;
+	bool       _failed     = false;
+
+	arena(void *buffer, uint64 size, grow_fn grow = default_grow, release_fn release = default_release)
+		: _buffer(static_cast<uint8 *>(buffer)), _buffer_size(size), _grow(grow), _release(release) {
+		reset();
+	}
+
+	explicit arena(grow_fn grow = default_grow, release_fn release = default_release)
+		: arena(nullptr, 0, grow, release) {}
+
+	arena(const arena &)            = delete;
+	arena &operator=(const arena &) = delete;
+
+	~arena() {
+		if (_release == nullptr) { return; }
+		for (chunk *c = _chunks; c != nullptr;) {
+			chunk *next = c->next;
+			_release(c, c->size);
+			c = next;
+		}
+	}
+
+	// align has to be a power of two.
+	void *allocate(uint64 bytes, uint64 align = 16) {
+		const uint64 padding = -reinterpret_cast<uint64>(_pos) & (align - 1);
+		if (padding <= _left && bytes <= _left - padding) {
+			uint8 *result = _pos + padding;
+			_pos          = result + bytes;
+			_left -= padding + bytes;
+			return result;
+		}
+		return allocate_in_next_chunk(bytes, align);
+	}
+
+	template<class T>
+	T *allocate(uint64 n) {
+		return static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+	}
+
+	// Grows the last allocation in place, if nothing was allocated after it and the chunk has room.
+	bool extend(void *allocation, uint64 bytes, uint64 new_bytes) {
+		if (static_cast<uint8 *>(allocation) + bytes != _pos || new_bytes - bytes > _left) { return false; }
+		_pos += new_bytes - bytes;
+		_left -= new_bytes - bytes;
+		return true;
+	}
+
+	void reset() {
+		_current = nullptr;
+		_pos     = _buffer;
+		_left    = _buffer_size;
+		_failed  = false;
+	}
+
+	[[nodiscard]] bool failed() const { return _failed; }
+
+	void *allocate_in_next_chunk(uint64 bytes, uint64 align) {
+		// Kept chunks that are too small for this allocation stay unused until the next reset.
+		for (chunk *c = _current == nullptr ? _chunks : _current->next; c != nullptr; c = c->next) {
+			enter(c);
+			if (align - 1 + bytes <= _left) { return allocate(bytes, align); }
+		}
+
+		const uint64 size = it::max(2 * _chunk_size, sizeof(chunk) + align - 1 + bytes);
+		chunk       *c    = _grow == nullptr ? nullptr : static_cast<chunk *>(_grow(size));
+		if (c == nullptr) {
+			_failed = true;
+			return nullptr;
+		}
+		_chunk_size = size;
+
+		chunk *&link = _current == nullptr ? _chunks : _current->next;
+		c->next      = link;
+		c->size      = size;
+		link         = c;
+		enter(c);
+		return allocate(bytes, align);
+	}
+
+	void enter(chunk *c) {
+		_current = c;
+		_pos     = reinterpret_cast<uint8 *>(c + 1);
+		_left    = c->size - sizeof(chunk);
+	}
+};
+
+namespace algo {
+
+	/*
+	 * Materializes the iterator into the arena and returns a contiguous it::iterator over the result.
+	 * A counting iterator gets exactly count() elements reserved, unless its count is costly.
+	 * Otherwise the space doubles, in place while nothing else was allocated in between.
+	 * Blocks are written directly into the result, blocks that point into a contiguous source are memcpy'd.
+	 * If the arena runs out of memory, the result is truncated and a.failed() is set.
+	 */
+	template<it::CustomIterator CI>
+		requires it::TriviallyCopyable<typename CI::value_type>
+	it::iterator<typename CI::value_type> collect_into(CI it, arena &a) {
+		using T = typename CI::value_type;
+
+		uint64 capacity = it::block_size;
+		if constexpr (it::CheapCountingIterator<CI>) { capacity = it.count(); }
+		T     *data = a.allocate<T>(capacity);
+		uint64 size = 0;
+		if (data == nullptr) { return {data, uint64(0)}; }
+
+		const auto grow = [&]() {
+			const uint64 bigger = 2 * capacity + it::block_size;
+			if (!a.extend(data, capacity * sizeof(T), bigger * sizeof(T))) {
+				T *moved = a.allocate<T>(bigger);
+				if (moved == nullptr) { return false; }
+				__builtin_memcpy(moved, data, size * sizeof(T));
+				data = moved;
+			}
+			capacity = bigger;
+			return true;
+		};
+
+		if constexpr (it::BlockIterator<CI>) {
+			while (it.has_next()) {
+				if (size == capacity && !grow()) { break; }
+				const auto b = it.next_block(data + size, capacity - size);
+				if (b.size == 0) { break; }
+				if (b.data != data + size) { __builtin_memcpy(data + size, b.data, b.size * sizeof(T)); }
+				size += b.size;
+			}
+		} else {
+			while (it.has_next()) {
+				if (size == capacity && !grow()) { break; }
+				data[size++] = *it;
+				++it;
+			}
+		}
+		return {data, size};
+	}
+	struct collect_into_ {
+		arena *_arena;
+	};
+	inline auto collect_into(arena &a) { return collect_into_{&a}; }
+	template<it::CustomIterator CI>
+		requires it::TriviallyCopyable<typename CI::value_type>
+	auto operator|(CI it, collect_into_ collect) {
+		return collect_into(it, *collect._arena);
+	}
+
+} // namespace algo
+
+#endif //D_ITERATOR_ARENA_H
@@ -8,6 +8,75 @@
 
 #include "iterator.h"
 
+#if !defined(NO_STD)
+#include <initializer_list>
+#endif
+
+/*
+ * A non-owning view of contiguous elements, e.g. of an array or a part of it.
+ * It is also the iterator over them, head_tail() and slice() are O(1).
+ * The viewed elements have to outlive the view, construct an array from it to own a copy.
+ */
+template<class T>
+struct array_view : it::cpp_iterator_adapter<array_view<T>> {
+	using value_type = T;
+
+	const T *_data = nullptr;
+	uint64   _size = 0;
+
+	constexpr array_view() = default;
+
+	constexpr array_view(const T *data, uint64 size) : _data(data), _size(size) {}
+
+	constexpr T operator[](uint64 i) const { return _data[i]; }
+
+	[[nodiscard]] constexpr auto head_tail() const {
+		struct head_tail_pair {
+			T          head;
+			array_view tail;
+		};
+
+		return head_tail_pair{_data[0], array_view(_data + 1, _size - 1)};
+	}
+
+	// The elements from i up to, but excluding j.
+	[[nodiscard]] constexpr array_view slice(uint64 i, uint64 j) const { return {_data + i, j - i}; }
+
+	[[nodiscard]] constexpr array_view to_iterator() const { return *this; }
+
+	[[nodiscard]] constexpr bool has_next() const { return _size != 0; }
+	constexpr T                  operator*() const { return *_data; }
+	constexpr void               operator++() {
+		_data++;
+		_size--;
+	}
+
+	[[nodiscard]] constexpr uint64 count() const { return _size; }
+
+	[[nodiscard]] constexpr const T *data() const { return _data; }
+
+	constexpr void operator+=(uint64 n) {
+		_data += n;
+		_size -= n;
+	}
+
+	constexpr T peek(uint64 n) const { return _data[n]; }
+
+	constexpr it::block<T> next_block(T *, uint64 n)
+		requires it::BlockValue<T>
+	{
+		const it::block<T> result = {_data, it::min(n, _size)};
+		*this += result.size;
+		return result;
+	}
+
+	[[nodiscard]] constexpr uint64 split_size() const { return _size; }
+
+	[[nodiscard]] constexpr it::split_pair<array_view> split_at(uint64 k) const {
+		return {slice(0, k), slice(k, _size)};
+	}
+};
+
 /*
  * This array is a fixed size array.
  * Mostly equivalent to std::array.
@@ -15,9 +84,10 @@
  *  - it is not lazy
  *  - it is not immutable
  *  - it doesn't have a variable size
- *  - the head, tail is a copy of the original array
+ *  - the tail of head_tail() is an array_view into the original array
  *
- * Because of the copy, it is not recommended to use this array for large arrays.
+ * head_tail(), slice() and to_iterator() don't copy, so the array has to outlive their results.
+ * Copies are only made by the copy constructor, array(array_view) and to_owning_iterator().
  */
 template<class T, uint64 size>
 struct array {
@@ -28,29 +98,29 @@ struct array {
 
 	static constexpr uint64 length = size;
 
+	[[nodiscard]] constexpr array_view<T> view() const { return {arr, size}; }
+
 	[[nodiscard]] constexpr auto head_tail() const
 		requires(size > 0)
 	{
-
-		struct head_tail_pair {
-			T                  head;
-			array<T, size - 1> tail;
-		};
-
-		array<T, size - 1> tail;
-		if constexpr (size > 1) {
-			for (uint64 i = 0; i < size - 1; i++) { tail.arr[i] = arr[i + 1]; }
-		}
-
-		return head_tail_pair{arr[0], tail};
+		return view().head_tail();
 	}
 
+	// The elements from i up to, but excluding j.
+	[[nodiscard]] constexpr array_view<T> slice(uint64 i, uint64 j) const { return view().slice(i, j); }
+
 	explicit array(T e)
 		requires(size == 1)
 	{
 		arr[0] = e;
 	}
 
+	// Copies the first elements of the view, at most size.
+	explicit constexpr array(array_view<T> view) {
+		for (uint64 i = 0; i < it::min(size, view.count()); i++) { arr[i] = view[i]; }
+	}
+
+#if !defined(NO_STD)
 	array(std::initializer_list<T> l) {
 		uint64 i = 0;
 		for (const auto &e: l) {
@@ -58,6 +128,7 @@ struct array {
 			i++;
 		}
 	}
+#endif
 
 	bool operator==(const array<T, size> &other) const {
 		for (uint64 i = 0; i < size; i++) {
@@ -77,6 +148,7 @@ struct array {
 		return *this;
 	}
 
+	// Owns a copy of the array, so it may outlive it.
 	struct iterator {
 		array<T, size> arr;
 		int            index = 0;
@@ -89,9 +161,23 @@ struct array {
 		constexpr void               operator++() { index++; }
 
 		[[nodiscard]] uint64 count() const { return size - index; }
+
+		constexpr void operator+=(uint64 n) { index += int(n); }
+
+		constexpr T peek(uint64 n) const { return arr[index + n]; }
+
+		constexpr it::block<T> next_block(T *, uint64 n)
+			requires it::BlockValue<T>
+		{
+			const it::block<T> result = {arr.arr + index, it::min(n, uint64(size - index))};
+			index += int(result.size);
+			return result;
+		}
 	};
 
-	[[nodiscard]] constexpr auto to_iterator() const { return iterator(*this, 0); }
+	[[nodiscard]] constexpr array_view<T> to_iterator() const { return view(); }
+
+	[[nodiscard]] constexpr auto to_owning_iterator() const { return iterator(*this, 0); }
 
 	~array() = default;
 };
@@ -103,22 +189,14 @@ struct array<T, 0> {
 
 	constexpr T &operator[](uint64) { __builtin_unreachable(); }
 
-	struct empty_iterator {
-		using value_type = T;
-		[[nodiscard]] constexpr bool has_next() const { return false; }
-		constexpr T                  operator*() const { return T(); }
-		constexpr void               operator++() { /* */
-		}
-
-		[[nodiscard]] uint64 count() const { return 0; }
-	};
+	[[nodiscard]] constexpr array_view<T> view() const { return {}; }
 
-	constexpr auto to_iterator() { return empty_iterator{}; }
+	[[nodiscard]] constexpr array_view<T> to_iterator() const { return {}; }
 };
 
 
 template<class T, uint64 size>
-array<T, size + 1> operator+(T e, array<T, size> arr) {
+array<T, size + 1> operator+(T e, const array<T, size> &arr) {
 	auto result = it::undefined<array<T, size + 1>>();
 
 	result.arr[0] = e;
@@ -131,6 +209,143 @@ array<T, 1> operator+(T e, array<T, 0>) {
 	return result;
 }
 
+/*
+ * Up to N unsigned values of Bits bits each, packed into one Storage integer (uint64 or uint128),
+ * element 0 in the lowest bits. The size is dynamic, up to N.
+ * push_front, head_tail and == are a few shifts and masks, independent of the size.
+ *
+ * The SWAR (SIMD within a register) operations work on all lanes at once:
+ * broadcast and iota build lane vectors, add and sub compute lane-wise modulo 2^Bits
+ * and equal returns the top bit of every lane that is equal, so a whole configuration is checked in a few instructions.
+ */
+template<uint64 Bits, uint64 N, class Storage = uint64>
+	requires(Bits >= 1 && Bits <= 16 && N >= 1 && Bits * N <= 8 * sizeof(Storage))
+struct packed_array {
+	using value_type = it::type_if_t<(Bits <= 8), uint8, uint16>;
+
+	static constexpr uint64 width = 8 * sizeof(Storage);
+
+	// The lowest n bits.
+	static constexpr Storage low_bits(uint64 n) { return n >= width ? ~Storage(0) : (Storage(1) << n) - 1; }
+
+	static constexpr Storage lane_mask = low_bits(Bits);
+
+	static constexpr Storage lane_ones = [] {
+		Storage ones = 0;
+		for (uint64 i = 0; i < N; i++) { ones |= Storage(1) << (i * Bits); }
+		return ones;
+	}();
+	static constexpr Storage lane_highs = lane_ones << (Bits - 1);
+	static constexpr Storage lane_lows  = lane_highs - lane_ones;
+
+	Storage arr  = 0;
+	uint32  size = 0;
+
+	constexpr packed_array() = default;
+
+	constexpr packed_array(Storage arr, uint32 size) : arr(arr & low_bits(size * Bits)), size(size) {}
+
+	constexpr value_type operator[](uint64 i) const { return value_type((arr >> (i * Bits)) & lane_mask); }
+
+	// The last element is dropped if the array is full.
+	[[nodiscard]] constexpr packed_array push_front(value_type e) const {
+		return {arr << Bits | (Storage(e) & lane_mask), it::min(size + 1, uint32(N))};
+	}
+
+	[[nodiscard]] constexpr auto head_tail() const {
+		struct head_tail_pair {
+			value_type   head;
+			packed_array tail;
+		};
+
+		return head_tail_pair{(*this)[0], packed_array(arr >> Bits, size - 1)};
+	}
+
+	constexpr bool operator==(const packed_array &other) const {
+		return size == other.size && arr == other.arr;
+	}
+
+	static constexpr Storage broadcast(value_type e) { return (Storage(e) & lane_mask) * lane_ones; }
+
+	// Lane i holds first + i.
+	static constexpr Storage iota(value_type first) {
+		Storage lanes = 0;
+		for (uint64 i = N; i-- > 0;) { lanes = lanes << Bits | (Storage(first + i) & lane_mask); }
+		return lanes;
+	}
+
+	// The top bits can't carry into the next lane, they are added without carry.
+	static constexpr Storage add(Storage a, Storage b) {
+		return ((a & lane_lows) + (b & lane_lows)) ^ ((a ^ b) & lane_highs);
+	}
+
+	static constexpr Storage sub(Storage a, Storage b) {
+		return ((a | lane_highs) - (b & lane_lows)) ^ ((a ^ ~b) & lane_highs);
+	}
+
+	// The top bit of every lane within the size that equals the lane of lanes.
+	[[nodiscard]] constexpr Storage equal(Storage lanes) const {
+		const Storage diff     = arr ^ lanes;
+		const Storage non_zero = (((diff & lane_lows) + lane_lows) | diff) & lane_highs;
+		return ~non_zero & lane_highs & low_bits(size * Bits);
+	}
+
+	[[nodiscard]] constexpr bool contains(value_type e) const { return equal(broadcast(e)) != 0; }
+
+	[[nodiscard]] constexpr uint64 count_equal(value_type e) const { return popcount(equal(broadcast(e))); }
+
+	static constexpr uint64 popcount(Storage x) {
+		if constexpr (sizeof(Storage) > 8) {
+			return uint64(__builtin_popcountll(uint64(x)) + __builtin_popcountll(uint64(x >> 64)));
+		} else {
+			return uint64(__builtin_popcountll(x));
+		}
+	}
+
+	// Shifts the elements out one by one, count and peek don't decode the other elements.
+	struct iterator : it::cpp_iterator_adapter<iterator> {
+		using value_type = packed_array::value_type;
+
+		Storage _arr;
+		uint64  _left;
+
+		constexpr iterator(Storage arr, uint64 left) : _arr(arr), _left(left) {}
+
+		[[nodiscard]] constexpr bool has_next() const { return _left != 0; }
+		constexpr value_type         operator*() const { return value_type(_arr & lane_mask); }
+		constexpr void               operator++() {
+			_arr >>= Bits;
+			_left--;
+		}
+
+		[[nodiscard]] constexpr uint64 count() const { return _left; }
+
+		constexpr void operator+=(uint64 n) {
+			_arr = n * Bits >= width ? 0 : _arr >> (n * Bits);
+			_left -= n;
+		}
+
+		constexpr value_type peek(uint64 n) const { return value_type((_arr >> (n * Bits)) & lane_mask); }
+
+		constexpr it::block<value_type> next_block(value_type *buffer, uint64 n) {
+			const uint64 m = it::min(n, _left);
+			for (uint64 i = 0; i < m; i++) {
+				buffer[i] = **this;
+				++*this;
+			}
+			return {buffer, m};
+		}
+	};
+
+	[[nodiscard]] constexpr iterator to_iterator() const { return iterator(arr, size); }
+};
+
+template<uint64 Bits, uint64 N, class Storage>
+constexpr packed_array<Bits, N, Storage> operator+(typename packed_array<Bits, N, Storage>::value_type e,
+												   packed_array<Bits, N, Storage>                    arr) {
+	return arr.push_front(e);
+}
+
 /*
  * Only exposed in unit testing.
  */
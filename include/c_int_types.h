@@ -42,4 +42,8 @@ using float64 = double;
 
 #endif
 
+#if defined(__SIZEOF_INT128__)
+__extension__ typedef unsigned __int128 uint128;
+#endif
+
 #endif //TINY_CPP_C_INT_TYPES_H
@@ -0,0 +1,229 @@
+//
+// Created by af on 16/10/26.
+//
+
+#ifndef D_ITERATOR_FD_READER_H
+#define D_ITERATOR_FD_READER_H
+
+#include "iterator.h"
+
+#if !defined(NO_STD) && __has_include(<unistd.h>)
+#include <cerrno>
+#include <condition_variable>
+#include <fcntl.h>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <unistd.h>
+
+/*
+ * Fixed size records streamed from a file descriptor, e.g. a pipe, a FIFO or a file too large to map.
+ * The records are read into three buffers of the same size, one is consumed while another one is filled,
+ * so the memory use doesn't depend on the input size.
+ * The buffer of the last block isn't refilled either, a consumer may still hold the block while it advances
+ * element by element into the next buffer, like a filter that skips rejected elements.
+ * The bytes of a record that straddles two reads are moved to the front of the next buffer,
+ * so the records in a buffer are always contiguous and aligned and blocks point directly into it.
+ * A trailing partial record is ignored.
+ *
+ * With read_ahead the next buffer is filled by a helper thread while the pipeline works on the current one,
+ * otherwise read() is called when the current buffer is exhausted.
+ * The iterators returned by to_iterator() share the position of the reader, so the input is read only once,
+ * and they aren't CopyableIterators.
+ */
+namespace it {
+
+	struct fd_options {
+		uint64 buffer_bytes = 1 << 20; // per buffer, at least one record
+		bool   read_ahead   = true;
+	};
+
+	template<TriviallyCopyable T>
+	struct fd_reader {
+		static constexpr uint64 alignment
+				= max(uint64(alignof(T)), uint64(__STDCPP_DEFAULT_NEW_ALIGNMENT__));
+
+		int      _fd;
+		bool     _owns_fd;
+		bool     _read_ahead;
+		uint64   _capacity; // bytes per buffer, a multiple of sizeof(T)
+		uint8   *_buffers[3] = {nullptr, nullptr, nullptr};
+		uint64   _filled[3]  = {0, 0, 0};
+		uint64   _current    = 2; // the buffer that is consumed
+		uint64   _filling    = 0; // the buffer that is filled
+		uint64   _pinned     = 3; // the buffer of the last block, 3 if there is none
+		const T *_pos        = nullptr;
+		uint64   _left       = 0; // records left in the current buffer
+		uint64   _carry      = 0; // bytes of a partial record at the front of the buffer being filled
+		bool     _pending    = false;
+		bool     _eof        = false;
+		int      _error      = 0;
+
+		// The helper thread and its handshake, _requested is set by the reader and cleared by the helper.
+		std::thread             _helper;
+		std::mutex              _mutex;
+		std::condition_variable _wake;
+		bool                    _requested = false;
+		bool                    _stop      = false;
+
+		// Reads fd, which stays open.
+		explicit fd_reader(int fd, fd_options options = {}) : fd_reader(fd, false, options) {}
+
+		// On failure the input is empty and error() returns the errno.
+		explicit fd_reader(const char *path, fd_options options = {})
+			: fd_reader(::open(path, O_RDONLY | O_CLOEXEC), true, options) {}
+
+		fd_reader(int fd, bool owns_fd, fd_options options)
+			: _fd(fd), _owns_fd(owns_fd), _read_ahead(options.read_ahead),
+			  _capacity(max(options.buffer_bytes / sizeof(T), uint64(1)) * sizeof(T)) {
+			if (fd < 0) {
+				_error = errno;
+				_eof   = true;
+				return;
+			}
+#if defined(POSIX_FADV_SEQUENTIAL)
+			::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+			for (auto &buffer: _buffers) {
+				buffer = static_cast<uint8 *>(::operator new(_capacity, std::align_val_t(alignment)));
+			}
+			if (_read_ahead) { _helper = std::thread([this]() { run_helper(); }); }
+			request(0);
+		}
+
+		// The reader is shared by its iterators and the helper thread, so it stays in place.
+		fd_reader(const fd_reader &)            = delete;
+		fd_reader &operator=(const fd_reader &) = delete;
+
+		// Waits for a running read, which blocks as long as a pipe is open without data.
+		~fd_reader() {
+			if (_helper.joinable()) {
+				{
+					std::lock_guard lock(_mutex);
+					_stop = true;
+				}
+				_wake.notify_all();
+				_helper.join();
+			}
+			for (auto *buffer: _buffers) {
+				if (buffer != nullptr) { ::operator delete(buffer, std::align_val_t(alignment)); }
+			}
+			if (_owns_fd && _fd >= 0) { ::close(_fd); }
+		}
+
+		[[nodiscard]] int error() const { return _error; }
+
+		struct iterator : cpp_iterator_adapter<iterator> {
+			using value_type = T;
+
+			fd_reader *_reader = nullptr;
+
+			iterator() = default;
+			explicit iterator(fd_reader *reader) : _reader(reader) {}
+
+			// Copies share the position, so without copy assignment the iterator isn't a CopyableIterator
+			// and adapters that traverse a copy, like prefetch, zip or cross_product, don't compile.
+			iterator(const iterator &)            = default;
+			iterator &operator=(const iterator &) = delete;
+
+			[[nodiscard]] bool has_next() const { return _reader->_left != 0 || _reader->next_buffer(); }
+			T                  operator*() const { return *_reader->_pos; }
+			void               operator++() {
+				_reader->_pos++;
+				_reader->_left--;
+			}
+
+			block<T> next_block(T *, uint64 n)
+				requires BlockValue<T>
+			{
+				if (!has_next()) { return {}; }
+				_reader->_pinned      = _reader->_current;
+				const block<T> result = {_reader->_pos, min(n, _reader->_left)};
+				_reader->_pos += result.size;
+				_reader->_left -= result.size;
+				return result;
+			}
+		};
+
+		[[nodiscard]] iterator to_iterator() { return iterator(this); }
+
+		// Switches to the buffer being filled and starts filling an idle one, false at the end of the input.
+		bool next_buffer() {
+			if (!_pending) { return false; }
+			wait();
+			_pending = false;
+
+			const uint64 bytes = _filled[_filling];
+			_left              = bytes / sizeof(T);
+			if (_left == 0) { return false; }
+			_current = _filling;
+			_pos     = reinterpret_cast<const T *>(_buffers[_current]);
+
+			// Neither consumed nor pinned, so the start of a straddling record can be moved there.
+			_filling = 0;
+			while (_filling == _current || _filling == _pinned) { _filling++; }
+			const uint64 carry = bytes - _left * sizeof(T);
+			if (!_eof) {
+				__builtin_memcpy(_buffers[_filling], _buffers[_current] + _left * sizeof(T), carry);
+				request(carry);
+			}
+			return true;
+		}
+
+		void request(uint64 carry) {
+			_carry   = carry;
+			_pending = true;
+			if (_read_ahead) {
+				{
+					std::lock_guard lock(_mutex);
+					_requested = true;
+				}
+				_wake.notify_all();
+			}
+		}
+
+		void wait() {
+			if (!_read_ahead) {
+				fill();
+				return;
+			}
+			std::unique_lock lock(_mutex);
+			_wake.wait(lock, [this]() { return !_requested; });
+		}
+
+		// Reads into the buffer being filled until it holds a record, a pipe may return less than requested.
+		void fill() {
+			uint8 *buffer = _buffers[_filling];
+			uint64 filled = _carry;
+			while (filled < sizeof(T)) {
+				const auto bytes = ::read(_fd, buffer + filled, _capacity - filled);
+				if (bytes < 0 && errno == EINTR) { continue; }
+				if (bytes <= 0) {
+					if (bytes < 0) { _error = errno; }
+					_eof = true;
+					break;
+				}
+				filled += uint64(bytes);
+			}
+			_filled[_filling] = filled;
+		}
+
+		void run_helper() {
+			std::unique_lock lock(_mutex);
+			while (true) {
+				_wake.wait(lock, [this]() { return _requested || _stop; });
+				if (_stop) { return; }
+				lock.unlock();
+				fill();
+				lock.lock();
+				_requested = false;
+				_wake.notify_all();
+			}
+		}
+	};
+
+} // namespace it
+
+#endif
+
+#endif //D_ITERATOR_FD_READER_H
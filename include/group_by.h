@@ -0,0 +1,312 @@
+//
+// Created by af on 16/10/26.
+//
+
+#ifndef D_ITERATOR_GROUP_BY_H
+#define D_ITERATOR_GROUP_BY_H
+
+#include "arena.h"
+#include "array.h"
+
+/*
+ * Keyed aggregation: every element is folded into the aggregate of its key,
+ * the result is an iterator over the (key, aggregate) groups.
+ *
+ * The groups live in a flat_table, an open addressing hash table in an arena, so it works with NO_STD.
+ * The groups are stored densely in the order of their first occurrence, the table itself only holds
+ * a control byte and a group index per slot. The control byte of a used slot is 7 bits of the hash,
+ * so a probe compares a whole group of 16 slots with one SSE2 compare and looks at a group
+ * only if those bits match. Probing is linear over the groups of slots.
+ * The table doubles at 7/8 load and nothing is ever removed, so a group with an empty slot ends a probe.
+ *
+ * The keys and hashes of a block are computed first and the buckets of all of them are prefetched,
+ * so a table larger than the cache waits for the misses of a block at once instead of one after the other.
+ */
+namespace algo {
+
+	template<typename K, typename A>
+	struct group {
+		K key;
+		A value;
+	};
+
+	// Integers are mixed, so the position and the control byte don't depend on the same few bits.
+	struct hash {
+		template<simd::Integer K>
+		constexpr uint64 operator()(K key) const {
+			const uint64 h = uint64(key) * 0x9E3779B97F4A7C15ULL;
+			return h ^ h >> 29;
+		}
+
+		constexpr uint64 operator()(array_view<char> key) const {
+			uint64      h    = key.count() * 0x9E3779B97F4A7C15ULL;
+			const char *data = key.data();
+			uint64      i    = 0;
+			for (; i + 8 <= key.count(); i += 8) {
+				uint64 word = 0;
+				for (uint64 b = 0; b < 8; b++) { word |= uint64(uint8(data[i + b])) << 8 * b; }
+				h = (h ^ word) * 0xD6E8FEB86659FD93ULL;
+				h ^= h >> 29;
+			}
+			uint64 tail = 0;
+			for (uint64 b = 0; i + b < key.count(); b++) { tail |= uint64(uint8(data[i + b])) << 8 * b; }
+			return (*this)(h ^ tail);
+		}
+	};
+
+	struct equal {
+		template<typename K>
+		constexpr bool operator()(const K &a, const K &b) const {
+			return a == b;
+		}
+
+		constexpr bool operator()(array_view<char> a, array_view<char> b) const {
+			if (a.count() != b.count()) { return false; }
+			for (uint64 i = 0; i < a.count(); i++) {
+				if (a[i] != b[i]) { return false; }
+			}
+			return true;
+		}
+	};
+
+	template<it::TriviallyCopyable K, it::TriviallyCopyable A, class HASH = hash, class EQUAL = equal>
+	struct flat_table {
+		static constexpr uint8  empty       = 0x80;
+		static constexpr uint64 min_buckets = 1; // groups of slots
+
+		arena       *_arena;
+		uint8       *_control = nullptr; // one byte per slot, empty or the low 7 bits of the hash
+		uint32      *_index   = nullptr; // the group in a used slot
+		group<K, A> *_groups  = nullptr;
+		uint64       _size    = 0;
+		uint64       _buckets = 0;
+		HASH         _hash;
+		EQUAL        _equal;
+
+		// If the arena can't hold the first buckets, every insert fails.
+		explicit flat_table(arena &a, uint64 expected = 0, HASH hash = {}, EQUAL equal = {})
+			: _arena(&a), _hash(hash), _equal(equal) {
+			uint64 buckets = min_buckets;
+			while (capacity(buckets) < expected) { buckets *= 2; }
+			rehash(buckets);
+		}
+
+		// At most 7/8 of the slots are used.
+		static constexpr uint64 capacity(uint64 buckets) { return buckets * simd::group_bytes / 8 * 7; }
+
+		[[nodiscard]] uint64 count() const { return _size; }
+
+		// The groups in the order of their first insertion, they move when the table grows.
+		[[nodiscard]] array_view<group<K, A>> to_iterator() const { return {_groups, _size}; }
+
+		[[nodiscard]] uint64 hash_of(K key) const { return _hash(key); }
+
+		// The control bytes and indices of the bucket where the probe for h starts.
+		void prefetch(uint64 h) const {
+			if (_control == nullptr) { return; }
+			const uint64 slot = (h >> 7 & (_buckets - 1)) * simd::group_bytes;
+			__builtin_prefetch(_control + slot);
+			__builtin_prefetch(_index + slot);
+		}
+
+		// The group that find(key, h) compares first, after prefetch(h) has brought in its bucket.
+		void prefetch_candidate(uint64 h) const {
+			if (_size == 0) { return; }
+			const uint64 slot = (h >> 7 & (_buckets - 1)) * simd::group_bytes;
+			const uint32 m    = simd::match_group(_control + slot, uint8(h & 0x7F));
+			__builtin_prefetch(_groups + _index[slot + uint64(__builtin_ctz(m | 1U << 15))]);
+		}
+
+		group<K, A> *find(K key) const { return find(key, _hash(key)); }
+
+		/*
+		 * Nearly every lookup is decided by its first bucket and the first tag match in it.
+		 * That case is computed without a branch on the outcome, so random hits and misses don't mispredict.
+		 * If no tag matches, the candidate is the group of the last slot, which is a valid group
+		 * because the index of an empty slot is 0, and the comparison is masked.
+		 * Selecting group 0 instead let GCC branch on the tag match.
+		 */
+		group<K, A> *find(K key, uint64 h) const {
+			if (_size == 0) { return nullptr; }
+			const uint64 slot    = (h >> 7 & (_buckets - 1)) * simd::group_bytes;
+			const uint32 m       = simd::match_group(_control + slot, uint8(h & 0x7F));
+			group<K, A> *g       = _groups + _index[slot + uint64(__builtin_ctz(m | 1U << 15))];
+			const bool   hit     = (m != 0) & _equal(g->key, key);
+			const bool   decided = hit | (((m & (m - 1)) == 0) & (simd::match_group(_control + slot, empty) != 0));
+			if (!decided) [[unlikely]] { return find_probe(key, h); }
+			return hit ? g : nullptr;
+		}
+
+		group<K, A> *find_probe(K key, uint64 h) const {
+			const uint8 tag = uint8(h & 0x7F);
+			for (uint64 b = h >> 7;; b++) {
+				const uint64 slot = (b & (_buckets - 1)) * simd::group_bytes;
+				for (uint32 m = simd::match_group(_control + slot, tag); m != 0; m &= m - 1) {
+					group<K, A> *g = _groups + _index[slot + uint64(__builtin_ctz(m))];
+					if (_equal(g->key, key)) { return g; }
+				}
+				if (simd::match_group(_control + slot, empty) != 0) { return nullptr; }
+			}
+		}
+
+		group<K, A> *insert(K key, A initial) { return insert(key, _hash(key), initial); }
+
+		// The group of key, inserted with the initial aggregate if there is none.
+		// nullptr if the arena is out of memory.
+		group<K, A> *insert(K key, uint64 h, A initial) {
+			const uint8 tag = uint8(h & 0x7F);
+			for (uint64 b = h >> 7; _control != nullptr; b++) {
+				const uint64 slot = (b & (_buckets - 1)) * simd::group_bytes;
+				for (uint32 m = simd::match_group(_control + slot, tag); m != 0; m &= m - 1) {
+					group<K, A> *g = _groups + _index[slot + uint64(__builtin_ctz(m))];
+					if (_equal(g->key, key)) [[likely]] { return g; }
+				}
+				if (simd::match_group(_control + slot, empty) != 0) { return add(key, h, initial); }
+			}
+			return nullptr;
+		}
+
+		// Appends a group for a key that isn't in the table yet.
+		group<K, A> *add(K key, uint64 h, A initial) {
+			if (_size == capacity(_buckets) && !rehash(2 * _buckets)) { return nullptr; }
+			place(h, _size);
+			_groups[_size] = {key, initial};
+			return _groups + _size++;
+		}
+
+		// Claims the first empty slot in the probe sequence of h for group g.
+		void place(uint64 h, uint64 g) {
+			for (uint64 b = h >> 7;; b++) {
+				const uint64 slot = (b & (_buckets - 1)) * simd::group_bytes;
+				const uint32 free = simd::match_group(_control + slot, empty);
+				if (free != 0) {
+					const uint64 i = slot + uint64(__builtin_ctz(free));
+					_control[i]    = uint8(h & 0x7F);
+					_index[i]      = uint32(g);
+					return;
+				}
+			}
+		}
+
+		// Adds the groups of other, the aggregates of keys in both are combined.
+		template<class COMBINE>
+		bool merge(const flat_table &other, COMBINE combine) {
+			for (const auto &o: other.to_iterator()) {
+				const uint64 size = _size;
+				group<K, A> *g    = insert(o.key, o.value);
+				if (g == nullptr) { return false; }
+				if (_size == size) { g->value = combine(g->value, o.value); }
+			}
+			return true;
+		}
+
+		// The groups are moved and the slots are rebuilt, the old arrays stay in the arena until its reset.
+		bool rehash(uint64 buckets) {
+			const uint64 slots   = buckets * simd::group_bytes;
+			uint8       *control = _arena->allocate<uint8>(slots);
+			uint32      *index   = _arena->allocate<uint32>(slots);
+			group<K, A> *groups  = _arena->allocate<group<K, A>>(capacity(buckets));
+			if (control == nullptr || index == nullptr || groups == nullptr) { return false; }
+			if (_size != 0) { __builtin_memcpy(groups, _groups, _size * sizeof(group<K, A>)); }
+
+			__builtin_memset(control, empty, slots);
+			__builtin_memset(index, 0, slots * sizeof(uint32));
+			_control = control;
+			_index   = index;
+			_groups  = groups;
+			_buckets = buckets;
+			for (uint64 g = 0; g < _size; g++) { place(_hash(_groups[g].key), g); }
+			return true;
+		}
+	};
+
+	/*
+	 * An aggregate is folded like reduce, starting from initial for every key.
+	 * combine merges two aggregates of the same key and is only needed by parallel_group_by.
+	 * Without one, parallel_group_by doesn't compile, the fold itself would be wrong for e.g. a count.
+	 */
+	struct no_combine {};
+
+	template<typename A, class FOLD, class COMBINE>
+	struct aggregator {
+		A       initial;
+		FOLD    fold;
+		COMBINE combine;
+	};
+	template<typename A, class FOLD, class COMBINE>
+	constexpr auto aggregate(A initial, FOLD fold, COMBINE combine) {
+		return aggregator<A, FOLD, COMBINE>{initial, fold, combine};
+	}
+	template<typename A, class FOLD>
+	constexpr auto aggregate(A initial, FOLD fold) {
+		return aggregator<A, FOLD, no_combine>{initial, fold, {}};
+	}
+
+	// Folds the iterator into the table, false if the arena ran out of memory.
+	template<it::CustomIterator CI, class KEY_FN, typename A, class FOLD, class COMBINE, typename K,
+			 class HASH, class EQUAL>
+	bool _i_group_into(CI it, KEY_FN key_fn, const aggregator<A, FOLD, COMBINE> &agg,
+					   flat_table<K, A, HASH, EQUAL> &table) {
+		using E = typename CI::value_type;
+		if constexpr (it::BlockIterator<CI>) {
+			E      buffer[it::block_size];
+			K      keys[it::block_size];
+			uint64 hashes[it::block_size];
+			for (auto b = it.next_block(buffer, it::block_size); b.size != 0;
+				 b      = it.next_block(buffer, it::block_size)) {
+				for (uint64 i = 0; i < b.size; i++) {
+					keys[i]   = key_fn(b.data[i]);
+					hashes[i] = table.hash_of(keys[i]);
+				}
+				for (uint64 i = 0; i < b.size; i++) { table.prefetch(hashes[i]); }
+				for (uint64 i = 0; i < b.size; i++) {
+					group<K, A> *g = table.insert(keys[i], hashes[i], agg.initial);
+					if (g == nullptr) { return false; }
+					g->value = agg.fold(g->value, b.data[i]);
+				}
+			}
+			return true;
+		}
+		while (it.has_next()) {
+			const E      e = *it;
+			group<K, A> *g = table.insert(key_fn(e), agg.initial);
+			if (g == nullptr) { return false; }
+			g->value = agg.fold(g->value, e);
+			++it;
+		}
+		return true;
+	}
+
+	template<class KEY_FN, typename E>
+	using group_key_t
+			= it::remove_reference_t<decltype(it::_declare_val<KEY_FN>()(it::_declare_val<E>()))>;
+
+	/*
+	 * The groups of the elements by key_fn, in the order of the first occurrence of their keys.
+	 * The table is built in the arena and the groups stay there, like the result of collect_into.
+	 * If the arena runs out of memory, the elements after that are dropped and a.failed() is set.
+	 */
+	template<it::CustomIterator CI, class KEY_FN, typename A, class FOLD, class COMBINE>
+	auto group_by(CI it, KEY_FN key_fn, aggregator<A, FOLD, COMBINE> agg, arena &a) {
+		flat_table<group_key_t<KEY_FN, typename CI::value_type>, A> table(a);
+		_i_group_into(it, key_fn, agg, table);
+		return table.to_iterator();
+	}
+	template<class KEY_FN, typename A, class FOLD, class COMBINE>
+	struct group_by_ {
+		KEY_FN                       _key_fn;
+		aggregator<A, FOLD, COMBINE> _agg;
+		arena                       *_arena;
+	};
+	template<class KEY_FN, typename A, class FOLD, class COMBINE>
+	auto group_by(KEY_FN key_fn, aggregator<A, FOLD, COMBINE> agg, arena &a) {
+		return group_by_<KEY_FN, A, FOLD, COMBINE>{key_fn, agg, &a};
+	}
+	template<it::CustomIterator CI, class KEY_FN, typename A, class FOLD, class COMBINE>
+	auto operator|(CI it, group_by_<KEY_FN, A, FOLD, COMBINE> group) {
+		return group_by(it, group._key_fn, group._agg, *group._arena);
+	}
+
+} // namespace algo
+
+#endif //D_ITERATOR_GROUP_BY_H
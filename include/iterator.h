@@ -6,15 +6,24 @@
 #define TINY_CPP_ITERATOR_H
 
 #include "c_int_types.h"
+#include "simd.h"
 
 #if !defined(NO_STD)
+#include <memory>
 #include <tuple>
 #include <type_traits>
+#else
+namespace it {
+	struct _i_placement {};
+} // namespace it
+// A placement new of its own, tagged so it can't clash with the one of <new> if that is included too.
+inline void *operator new(decltype(sizeof(0)), void *where, it::_i_placement) noexcept { return where; }
+inline void  operator delete(void *, void *, it::_i_placement) noexcept {}
 #endif
 
 
 namespace algo {
-	template<std::size_t idx, typename... Ts>
+	template<uint64 idx, typename... Ts>
 	struct template_element;
 
 	template<typename T, typename... Ts>
@@ -22,7 +31,7 @@ namespace algo {
 		using type = T;
 	};
 
-	template<std::size_t idx, typename T, typename... Ts>
+	template<uint64 idx, typename T, typename... Ts>
 	struct template_element<idx, T, Ts...> {
 		static_assert(idx < sizeof...(Ts) + 1, "Index out of bounds.");
 		using type = typename template_element<idx - 1, Ts...>::type;
@@ -76,6 +85,22 @@ namespace it {
 		return a > b ? b : a;
 	}
 
+	// The default order of sorting algorithms.
+	struct _i_less {
+		template<typename T>
+		constexpr bool operator()(const T &a, const T &b) const {
+			return a < b;
+		}
+	};
+
+	// The default operation of scans, integer sums of blocks are vectorized.
+	struct _i_plus {
+		template<typename A, typename B>
+		constexpr A operator()(const A &a, const B &b) const {
+			return a + A(b);
+		}
+	};
+
 	template<typename T, typename U>
 	struct is_same {
 		static constexpr bool value = false;
@@ -173,6 +198,16 @@ namespace it {
 
 	bool operator|(bool b, negate) { return !b; }
 
+	// For members that have to be replaced but can't be assigned, e.g. iterators that hold a capturing lambda.
+	template<typename T, typename ARG>
+	constexpr void _i_construct_at(T *where, ARG &&arg) {
+#if defined(NO_STD)
+		::new (static_cast<void *>(where), _i_placement{}) T(static_cast<ARG &&>(arg));
+#else
+		std::construct_at(where, static_cast<ARG &&>(arg));
+#endif
+	}
+
 	// type_if_t<condition, type_if_true, type_if_false>
 	template<bool condition, typename T, typename F>
 	struct type_if {
@@ -203,6 +238,104 @@ namespace it {
 	concept CountingIterator
 			= CustomIterator<T> && requires(const T it, uint64 count) { count = it.count(); };
 
+	/*
+	 * An iterator whose count() reruns the pipeline, like flat_map, returns true from costly_count().
+	 * algo::count still uses it, but algorithms that only reserve memory with the count don't.
+	 */
+	template<typename T>
+	concept CostlyCount = requires { requires T::costly_count(); };
+
+	template<typename T>
+	concept CheapCountingIterator = CountingIterator<T> && !CostlyCount<T>;
+
+	/*
+	 * Block protocol: it.next_block(buffer, n) advances past up to n elements and returns them as a block.
+	 * The block either points into buffer or, for contiguous sources, directly into the source.
+	 * It stays valid until the iterator or the buffer is modified.
+	 * The block is empty only if n is 0 or the iterator is exhausted.
+	 * Processing a whole block per call lets the compiler vectorize the inner loops.
+	 * Only value types that fit into a plain stack buffer take part.
+	 */
+	template<typename T>
+	concept BlockValue = TriviallyCopyable<T> && requires(T a, T b) {
+		a = b;
+		T();
+	};
+
+	template<typename T>
+	struct block {
+		const T *data = nullptr;
+		uint64   size = 0;
+	};
+
+	inline constexpr uint64 block_size = 256;
+
+	template<typename T>
+	concept BlockIterator
+			= CustomIterator<T> && BlockValue<typename T::value_type>
+			  && requires(T it, typename T::value_type *buffer, uint64 n) {
+					 { it.next_block(buffer, n) } -> same_as<block<typename T::value_type>>;
+				 };
+
+	/*
+	 * Selection protocol: it.next_selection(buffer, selected, n) advances like next_block,
+	 * but returns the unfiltered block together with its selection vector (see simd::select).
+	 * selected must hold block_size bytes.
+	 * The block is empty only if n is 0 or the iterator is exhausted, but it may contain no selected element.
+	 */
+	template<typename T>
+	struct selection {
+		const T     *data     = nullptr;
+		uint64       size     = 0;
+		const uint8 *selected = nullptr;
+	};
+
+	template<typename T>
+	concept SelectionIterator
+			= BlockIterator<T>
+			  && requires(T it, typename T::value_type *buffer, uint8 *selected, uint64 n) {
+					 {
+						 it.next_selection(buffer, selected, n)
+						 } -> same_as<selection<typename T::value_type>>;
+				 };
+
+	/*
+	 * Split protocol: it.split_at(k) cuts the iterator into two independent iterators of the same type,
+	 * the first one covering the first k positions and the second one the rest.
+	 * it.split_size() is the number of positions, for a filter that's the number of source elements.
+	 * Both halves can be consumed on different threads, so parallel algorithms are built on it.
+	 */
+	template<typename T>
+	struct split_pair {
+		T first;
+		T second;
+	};
+
+	template<typename T>
+	concept SplittableIterator = CustomIterator<T> && requires(const T it, uint64 k) {
+		{ it.split_size() } -> same_as<uint64>;
+		{ it.split_at(k) } -> same_as<split_pair<T>>;
+	};
+
+	/*
+	 * Random access: it += n advances by n elements and it.peek(n) returns the element n positions ahead,
+	 * both in O(1). n must not exceed it.count(), for peek it must be smaller.
+	 */
+	template<typename T>
+	concept RandomAccessIterator = CountingIterator<T> && requires(T it, const T const_it, uint64 n) {
+		it += n;
+		{ const_it.peek(n) } -> ConvertibleTo<typename T::value_type>;
+	};
+
+	/*
+	 * Contiguous: it.data() points to the remaining it.count() elements, stored in order in memory.
+	 * Consumers can scan the memory directly, e.g. for delimiters, and hand out pointers into it.
+	 */
+	template<typename T>
+	concept ContiguousIterator = CountingIterator<T> && requires(const T it) {
+		{ it.data() } -> same_as<const typename T::value_type *>;
+	};
+
 	template<typename T>
 	concept ReverseIterator = CustomIterator<T> && requires(const T it) {
 		{ it.reverse() } -> same_as<typename T::reverse_t>;
@@ -281,6 +414,48 @@ namespace it {
 
 		[[nodiscard]] constexpr uint64 count() const { return _end - _begin; }
 
+		[[nodiscard]] constexpr const T *data() const
+			requires(direction == IteratorType::Forward)
+		{
+			return _begin;
+		}
+
+		constexpr void operator+=(uint64 n) {
+			if constexpr (direction == IteratorType::Forward) { _begin += n; }
+			if constexpr (direction == IteratorType::Reverse) { _end -= n; }
+		}
+
+		constexpr reference peek(uint64 n) const {
+			if constexpr (direction == IteratorType::Forward) { return _begin[n]; }
+			if constexpr (direction == IteratorType::Reverse) { return *(_end - n); }
+		}
+
+		constexpr block<value_type> next_block(pointer buffer, uint64 n)
+			requires BlockValue<value_type>
+		{
+			const uint64 m = min(n, count());
+			if constexpr (direction == IteratorType::Forward) {
+				const block<value_type> result = {_begin, m};
+				_begin += m;
+				return result;
+			}
+			if constexpr (direction == IteratorType::Reverse) {
+				for (uint64 i = 0; i < m; i++) { buffer[i] = *(_end - i); }
+				_end -= m;
+				return {buffer, m};
+			}
+		}
+
+		[[nodiscard]] constexpr uint64 split_size() const { return count(); }
+
+		[[nodiscard]] constexpr split_pair<iterator> split_at(uint64 k) const {
+			if constexpr (direction == IteratorType::Forward) {
+				return {iterator(_begin, _begin + k), iterator(_begin + k, _end)};
+			}
+			if constexpr (direction == IteratorType::Reverse) {
+				return {iterator(_end - k, _end), iterator(_begin, _end - k)};
+			}
+		}
 
 		// Equality comparison (needed for Regular concept)
 		friend bool operator==(const iterator &a, const iterator &b) {
@@ -321,6 +496,10 @@ namespace it {
 
 		[[nodiscard]] constexpr uint64 count() const { return iterated ? 0 : 1; }
 
+		constexpr void operator+=(uint64 n) { iterated = iterated || n != 0; }
+
+		constexpr value_type peek(uint64) const { return element; }
+
 		using reverse_t = single_element_iterator<T>;
 		[[nodiscard]] constexpr single_element_iterator<T> reverse() const { return *this; }
 	};
@@ -337,6 +516,20 @@ namespace it {
 		constexpr char operator*() const { return *sting; }
 
 		[[nodiscard]] constexpr bool has_next() const { return *sting != '\0'; }
+
+		// The count and the blocks are found with the word at a time scan in simd.h.
+		[[nodiscard]] constexpr uint64 count() const { return simd::strlen(sting); }
+
+		[[nodiscard]] constexpr const char *data() const { return sting; }
+
+		// The blocks point directly into the string, up to the terminator.
+		constexpr block<char> next_block(char *, uint64 n) {
+			const block<char> result = {sting, simd::c_string_scan(sting, n, '\0')};
+			sting += result.size;
+			return result;
+		}
+
+		[[nodiscard]] constexpr uint64 find(char c) const { return simd::c_string_scan(sting, ~0ULL, c); }
 	};
 
 	template<class T, IteratorType direction = IteratorType::Forward>
@@ -362,6 +555,38 @@ namespace it {
 
 		[[nodiscard]] constexpr uint64 count() const { return _end - _begin; }
 
+		constexpr void operator+=(uint64 n) {
+			if constexpr (direction == IteratorType::Forward) { _begin = T(_begin + n); }
+			if constexpr (direction == IteratorType::Reverse) { _end = T(_end - n); }
+		}
+
+		constexpr T peek(uint64 n) const {
+			if constexpr (direction == IteratorType::Forward) { return T(_begin + n); }
+			if constexpr (direction == IteratorType::Reverse) { return T(_end - n); }
+		}
+
+		constexpr block<T> next_block(T *buffer, uint64 n)
+			requires BlockValue<T>
+		{
+			const uint64 m = min(n, count());
+			for (uint64 i = 0; i < m; i++) {
+				buffer[i] = **this;
+				++*this;
+			}
+			return {buffer, m};
+		}
+
+		[[nodiscard]] constexpr uint64 split_size() const { return count(); }
+
+		[[nodiscard]] constexpr split_pair<sequence_generator> split_at(uint64 k) const {
+			if constexpr (direction == IteratorType::Forward) {
+				return {sequence_generator(_begin, T(_begin + k)), sequence_generator(T(_begin + k), _end)};
+			}
+			if constexpr (direction == IteratorType::Reverse) {
+				return {sequence_generator(T(_end - k), _end), sequence_generator(_begin, T(_end - k))};
+			}
+		}
+
 		using reverse_t = sequence_generator<T, !direction>;
 		[[nodiscard]] constexpr sequence_generator<T, !direction> reverse() const {
 			if constexpr (direction == IteratorType::Forward) {
@@ -390,6 +615,13 @@ namespace it {
 		[[nodiscard]] constexpr bool has_next() const { return true; }
 
 		[[nodiscard]] constexpr uint64 count() const { return ~0UL; }
+
+		constexpr block<T> next_block(T *buffer, uint64 n)
+			requires BlockValue<T>
+		{
+			for (uint64 i = 0; i < n; i++) { buffer[i] = _begin++; }
+			return {buffer, n};
+		}
 	};
 
 	template<typename T, typename ARG>
@@ -398,6 +630,7 @@ namespace it {
 	template<CustomIterator CI, MapFunction<typename CI::value_type> FN, class T>
 	struct _i_MapIterator : cpp_iterator_adapter<_i_MapIterator<CI, FN, T>> {
 		using value_type [[maybe_unused]] = T;
+		static constexpr bool costly_count() { return CostlyCount<CI>; }
 
 		CI _it;
 		FN _lambda;
@@ -417,6 +650,41 @@ namespace it {
 			return _it.count();
 		}
 
+		constexpr void operator+=(uint64 n)
+			requires RandomAccessIterator<CI>
+		{
+			_it += n;
+		}
+
+		constexpr value_type peek(uint64 n) const
+			requires RandomAccessIterator<CI>
+		{
+			return _lambda(_it.peek(n));
+		}
+
+		constexpr block<T> next_block(add_pointer_to_removed_reference_t<value_type> buffer, uint64 n)
+			requires BlockIterator<CI> && BlockValue<value_type>
+		{
+			typename CI::value_type inner_buffer[block_size];
+
+			const auto inner = _it.next_block(inner_buffer, min(n, block_size));
+			for (uint64 i = 0; i < inner.size; i++) { buffer[i] = _lambda(inner.data[i]); }
+			return {buffer, inner.size};
+		}
+
+		[[nodiscard]] constexpr uint64 split_size() const
+			requires SplittableIterator<CI>
+		{
+			return _it.split_size();
+		}
+
+		[[nodiscard]] constexpr split_pair<_i_MapIterator> split_at(uint64 k) const
+			requires SplittableIterator<CI>
+		{
+			const split_pair<CI> parts = _it.split_at(k);
+			return {_i_MapIterator(parts.first, _lambda), _i_MapIterator(parts.second, _lambda)};
+		}
+
 		template<CustomIterator _i_CI>
 		struct reverse_t_s;
 
@@ -447,6 +715,13 @@ namespace it {
 		return _i_MapIterator<CI, FN, decltype(lambda(*it))>(it, lambda);
 	}
 
+	// map | map is folded into one stage with the composed function.
+	template<CustomIterator CI, class F1, class T1, MapFunction<T1> F2>
+	constexpr auto map(_i_MapIterator<CI, F1, T1> it, F2 lambda) {
+		const auto composed = [first = it._lambda, lambda](auto &&x) { return lambda(first(x)); };
+		return map(it._it, composed);
+	}
+
 	template<typename FN>
 	struct map_ {
 		FN _lambda;
@@ -462,6 +737,210 @@ namespace it {
 	}
 
 
+	/*
+	 * Prefetches address_fn(e) for the element e that is distance positions ahead.
+	 * A later indirect load, like base[i], then finds its cache line already on the way.
+	 * The elements pass unchanged, but a following map is fused into the adapter,
+	 * so its block loop prefetches the element distance positions ahead while it loads the current one.
+	 * Prefetching a whole block ahead instead doesn't help, the loads have to be interleaved with the prefetches.
+	 * Random access sources peek ahead, other sources are copied and the copy runs ahead,
+	 * so their work is done twice.
+	 */
+	inline constexpr uint64 prefetch_distance = 64;
+
+	struct _i_identity {
+		constexpr auto operator()(auto x) const { return x; }
+	};
+
+	template<CopyableIterator CI, class AF, class FN, class T>
+	struct _i_PrefetchIterator : cpp_iterator_adapter<_i_PrefetchIterator<CI, AF, FN, T>> {
+		using value_type = T;
+		static constexpr bool costly_count() { return CostlyCount<CI>; }
+
+		struct none {
+			constexpr explicit none(const CI &) {}
+		};
+
+		CI _it;
+		// The copy that runs ahead, random access sources peek instead.
+		[[no_unique_address]] type_if_t<RandomAccessIterator<CI>, none, CI> _ahead;
+		AF                                                                  _address_fn;
+		FN                                                                  _lambda;
+		uint64                                                              _distance;
+
+		constexpr _i_PrefetchIterator(CI it, AF address_fn, FN lambda, uint64 distance)
+			: _it(it), _ahead(it), _address_fn(address_fn), _lambda(lambda),
+			  _distance(max(distance, uint64(1))) {
+			if constexpr (RandomAccessIterator<CI>) {
+				for (uint64 i = 0; i < min(_distance, _it.count()); i++) { issue(_it.peek(i)); }
+			} else {
+				for (uint64 i = 0; i < _distance; i++) { advance_ahead(); }
+			}
+		}
+
+		constexpr void issue(typename CI::value_type e) const {
+			if (!__builtin_is_constant_evaluated()) { __builtin_prefetch(_address_fn(e)); }
+		}
+
+		// Random access: prefetches the element n positions after _it.
+		constexpr void issue_at(uint64 n) const {
+			if constexpr (RandomAccessIterator<CI>) {
+				if (n < _it.count()) { issue(_it.peek(n)); }
+			}
+		}
+
+		// Other sources: prefetches the element of the copy and moves it on.
+		constexpr void advance_ahead() {
+			if constexpr (!RandomAccessIterator<CI>) {
+				if (_ahead.has_next()) {
+					issue(*_ahead);
+					++_ahead;
+				}
+			}
+		}
+
+		[[nodiscard]] constexpr bool has_next() const { return _it.has_next(); }
+
+		constexpr value_type operator*() const { return _lambda(*_it); }
+
+		constexpr void operator++() {
+			++_it;
+			issue_at(_distance - 1);
+			advance_ahead();
+		}
+
+		[[nodiscard]] constexpr uint64 count() const
+			requires CountingIterator<CI>
+		{
+			if constexpr (CountingIterator<CI>) { return _it.count(); }
+			return 0;
+		}
+
+		constexpr void operator+=(uint64 n)
+			requires RandomAccessIterator<CI>
+		{
+			if constexpr (RandomAccessIterator<CI>) {
+				_it += n;
+				for (uint64 i = 0; i < _distance; i++) { issue_at(i); }
+			}
+		}
+
+		constexpr value_type peek(uint64 n) const
+			requires RandomAccessIterator<CI>
+		{
+			if constexpr (RandomAccessIterator<CI>) { return _lambda(_it.peek(n)); }
+			return **this;
+		}
+
+		// Random access sources are read with peek, so the loop is the same as a hand written one.
+		constexpr block<value_type> next_block(add_pointer_to_removed_reference_t<value_type> buffer,
+											   uint64                                         n)
+			requires BlockIterator<CI> && BlockValue<value_type>
+		{
+			if constexpr (RandomAccessIterator<CI> && BlockValue<value_type>) {
+				const uint64 left  = _it.count();
+				const uint64 m     = min(min(n, block_size), left);
+				const uint64 ahead = left > _distance ? min(m, left - _distance) : 0;
+				uint64       i     = 0;
+				for (; i < ahead; i++) {
+					issue(_it.peek(i + _distance));
+					buffer[i] = _lambda(_it.peek(i));
+				}
+				for (; i < m; i++) { buffer[i] = _lambda(_it.peek(i)); }
+				_it += m;
+				return {buffer, m};
+			} else if constexpr (BlockIterator<CI> && BlockValue<value_type>) {
+				typename CI::value_type inner_buffer[block_size];
+
+				const auto inner = _it.next_block(inner_buffer, min(n, block_size));
+				for (uint64 i = 0; i < inner.size; i++) {
+					advance_ahead();
+					buffer[i] = _lambda(inner.data[i]);
+				}
+				return {buffer, inner.size};
+			}
+			return {};
+		}
+
+		[[nodiscard]] constexpr uint64 split_size() const
+			requires SplittableIterator<CI>
+		{
+			if constexpr (SplittableIterator<CI>) { return _it.split_size(); }
+			return 0;
+		}
+
+		[[nodiscard]] constexpr split_pair<_i_PrefetchIterator> split_at(uint64 k) const
+			requires SplittableIterator<CI>
+		{
+			if constexpr (SplittableIterator<CI>) {
+				const split_pair<CI> parts = _it.split_at(k);
+				return {_i_PrefetchIterator(parts.first, _address_fn, _lambda, _distance),
+						_i_PrefetchIterator(parts.second, _address_fn, _lambda, _distance)};
+			}
+			return {*this, *this};
+		}
+	};
+
+	template<CopyableIterator CI, MapFunction<typename CI::value_type> AF>
+	constexpr auto prefetch(CI it, AF address_fn, uint64 distance = prefetch_distance) {
+		using T = typename CI::value_type;
+		return _i_PrefetchIterator<CI, AF, _i_identity, T>(it, address_fn, _i_identity(), distance);
+	}
+
+	// prefetch | map keeps prefetching inside the map's loop.
+	template<CopyableIterator CI, class AF, class F1, class T1, MapFunction<T1> F2>
+	constexpr auto map(_i_PrefetchIterator<CI, AF, F1, T1> it, F2 lambda) {
+		const auto composed = [first = it._lambda, lambda](auto &&x) { return lambda(first(x)); };
+		using T             = decltype(composed(*it._it));
+		return _i_PrefetchIterator<CI, AF, decltype(composed), T>(it._it, it._address_fn, composed,
+																  it._distance);
+	}
+
+	template<typename AF>
+	struct prefetch_ {
+		AF     _address_fn;
+		uint64 _distance;
+	};
+	// The distance is a template argument, prefetch<32>(fn), or a function argument, prefetch(fn, distance).
+	template<uint64 distance = prefetch_distance, typename AF>
+	constexpr auto prefetch(AF address_fn) {
+		return prefetch_<AF>{address_fn, distance};
+	}
+	template<typename AF>
+	constexpr auto prefetch(AF address_fn, uint64 distance) {
+		return prefetch_<AF>{address_fn, distance};
+	}
+	template<CopyableIterator CI, MapFunction<typename CI::value_type> AF>
+	constexpr auto operator|(CI it, prefetch_<AF> prefetch) {
+		return it::prefetch(it, prefetch._address_fn, prefetch._distance);
+	}
+
+	// base[i] for every index i, with the loads prefetched distance indices ahead.
+	template<CopyableIterator CI, typename T>
+	constexpr auto gather(CI indices, const T *base, uint64 distance = prefetch_distance) {
+		using I = typename CI::value_type;
+		return map(prefetch(indices, [base](I i) { return base + i; }, distance),
+				   [base](I i) { return base[i]; });
+	}
+	template<typename T>
+	struct gather_ {
+		const T *_base;
+		uint64   _distance;
+	};
+	template<uint64 distance = prefetch_distance, typename T>
+	constexpr auto gather(const T *base) {
+		return gather_<T>{base, distance};
+	}
+	template<typename T>
+	constexpr auto gather(const T *base, uint64 distance) {
+		return gather_<T>{base, distance};
+	}
+	template<CopyableIterator CI, typename T>
+	constexpr auto operator|(CI indices, gather_<T> gather) {
+		return it::gather(indices, gather._base, gather._distance);
+	}
+
+
 	template<typename T, typename ARG>
 	concept PredicateFunction = requires(T it, ARG arg) {
 		{ it(arg) } -> same_as<bool>;
@@ -487,6 +966,49 @@ namespace it {
 
 		[[nodiscard]] constexpr bool has_next() const { return _it.has_next(); }
 
+		/*
+		 * The predicate is evaluated for the whole block without a data dependent branch.
+		 * Consumers that only need the number of elements can sum the selection vector.
+		 */
+		constexpr selection<value_type>
+		next_selection(add_pointer_to_removed_reference_t<value_type> buffer, uint8 *selected, uint64 n)
+			requires BlockIterator<CI>
+		{
+			const auto inner = _it.next_block(buffer, min(n, block_size));
+			simd::select(inner.data, inner.size, selected, _lambda);
+			while (_it.has_next() && !_lambda(*_it)) { ++_it; }
+			return {inner.data, inner.size, selected};
+		}
+
+		// The selection is compacted in place, so the block points into buffer.
+		constexpr block<value_type>
+		next_block(add_pointer_to_removed_reference_t<value_type> buffer, uint64 n)
+			requires BlockIterator<CI>
+		{
+			uint8 selected[block_size];
+
+			uint64 written = 0;
+			while (written == 0 && n != 0 && _it.has_next()) {
+				const auto s = next_selection(buffer, selected, n);
+				written      = simd::compress(s.data, s.size, s.selected, buffer);
+			}
+			return {buffer, written};
+		}
+
+		// The source is split, each half skips its own leading rejected elements.
+		[[nodiscard]] constexpr uint64 split_size() const
+			requires SplittableIterator<CI>
+		{
+			return _it.split_size();
+		}
+
+		[[nodiscard]] constexpr split_pair<_i_FilterIterator> split_at(uint64 k) const
+			requires SplittableIterator<CI>
+		{
+			const split_pair<CI> parts = _it.split_at(k);
+			return {_i_FilterIterator(parts.first, _lambda), _i_FilterIterator(parts.second, _lambda)};
+		}
+
 		template<CustomIterator _i_CI>
 		struct reverse_t_s;
 
@@ -516,54 +1038,203 @@ namespace it {
 
 		return _i_FilterIterator(it, lambda);
 	}
-	template<typename FN>
-	struct filter_ {
-		FN _lambda;
-		constexpr explicit filter_(FN lambda) : _lambda(lambda) {}
-	};
-	template<typename FN>
-	constexpr auto filter(FN lambda) {
-		return filter_<FN>(lambda);
-	}
-	template<CustomIterator CI, PredicateFunction<typename CI::value_type> FN>
-	constexpr auto operator|(CI it, filter_<FN> lambda) {
-		return filter(it, lambda._lambda);
-	}
-
-	template<CustomIterator CI>
-	constexpr auto take(CI it, uint64 n) {
-		using T = CI::value_type;
 
-		struct _ : cpp_iterator_adapter<_> {
-			using value_type [[maybe_unused]] = TypeMapper<T>::Type;
+	/*
+	 * map | filter as one stage, the mapped value is computed once and kept for the predicate and *it.
+	 * Without it the filter evaluates the map for the predicate and the consumer evaluates it again.
+	 */
+	template<CustomIterator CI, class FN, class PRED, BlockValue T>
+	struct _i_MapFilterIterator : cpp_iterator_adapter<_i_MapFilterIterator<CI, FN, PRED, T>> {
+		using value_type [[maybe_unused]] = T;
 
-			CI     _it;
-			uint64 _n;
+		CI   _it;
+		FN   _lambda;
+		PRED _predicate;
+		T    _value{};
 
-			constexpr _(CI it, uint64 n) : _it(it), _n(n) {}
+		constexpr _i_MapFilterIterator(CI it, FN lambda, PRED predicate)
+			: _it(it), _lambda(lambda), _predicate(predicate) {
+			skip();
+		}
 
-			constexpr void operator++() {
+		constexpr void skip() {
+			while (_it.has_next()) {
+				_value = _lambda(*_it);
+				if (_predicate(_value)) { return; }
 				++_it;
-				--_n;
 			}
+		}
 
-			constexpr value_type operator*() const { return *_it; }
+		constexpr void operator++() {
+			++_it;
+			skip();
+		}
 
-			[[nodiscard]] constexpr bool has_next() const { return _it.has_next() && _n > 0; }
+		constexpr value_type operator*() const { return _value; }
 
-			[[nodiscard]] constexpr uint64 count() const
-				requires CountingIterator<CI>
-			{
-				return _n;
-			}
-		};
+		[[nodiscard]] constexpr bool has_next() const { return _it.has_next(); }
+
+		constexpr selection<T> next_selection(T *buffer, uint8 *selected, uint64 n)
+			requires BlockIterator<CI>
+		{
+			typename CI::value_type inner_buffer[block_size];
+
+			const auto inner = _it.next_block(inner_buffer, min(n, block_size));
+			for (uint64 i = 0; i < inner.size; i++) { buffer[i] = _lambda(inner.data[i]); }
+			simd::select(buffer, inner.size, selected, _predicate);
+			skip();
+			return {buffer, inner.size, selected};
+		}
+
+		constexpr block<T> next_block(T *buffer, uint64 n)
+			requires BlockIterator<CI>
+		{
+			uint8 selected[block_size];
+
+			uint64 written = 0;
+			while (written == 0 && n != 0 && _it.has_next()) {
+				const auto s = next_selection(buffer, selected, n);
+				written      = simd::compress(s.data, s.size, s.selected, buffer);
+			}
+			return {buffer, written};
+		}
+
+		[[nodiscard]] constexpr uint64 split_size() const
+			requires SplittableIterator<CI>
+		{
+			return _it.split_size();
+		}
+
+		[[nodiscard]] constexpr split_pair<_i_MapFilterIterator> split_at(uint64 k) const
+			requires SplittableIterator<CI>
+		{
+			const split_pair<CI> parts = _it.split_at(k);
+			return {_i_MapFilterIterator(parts.first, _lambda, _predicate),
+					_i_MapFilterIterator(parts.second, _lambda, _predicate)};
+		}
+
+		template<CustomIterator _i_CI>
+		struct reverse_t_s;
+
+		template<CustomIterator _i_CI>
+			requires ReverseIterator<_i_CI>
+		struct reverse_t_s<_i_CI> {
+			using type = _i_MapFilterIterator<typename _i_CI::reverse_t, FN, PRED, T>;
+		};
+
+		template<CustomIterator _i_CI>
+			requires(!ReverseIterator<_i_CI>)
+		struct reverse_t_s<_i_CI> {
+			using type = void;
+		};
+
+		using reverse_t = typename reverse_t_s<CI>::type;
+
+		[[nodiscard]] constexpr auto reverse() const
+			requires ReverseIterator<CI>
+		{
+			return reverse_t(_it.reverse(), _lambda, _predicate);
+		}
+	};
+
+	/*
+	 * Adjacent stages are fused, filter | filter into one short-circuit predicate
+	 * and map | filter into a _i_MapFilterIterator.
+	 */
+	template<CustomIterator CI, class F1, PredicateFunction<typename CI::value_type> F2>
+	constexpr auto filter(_i_FilterIterator<CI, F1> it, F2 lambda) {
+		const auto both = [first = it._lambda, lambda](const auto &x) { return first(x) && lambda(x); };
+		return _i_FilterIterator(it._it, both);
+	}
+
+	template<CustomIterator CI, class FN, BlockValue T, PredicateFunction<T> PRED>
+	constexpr auto filter(_i_MapIterator<CI, FN, T> it, PRED predicate) {
+		return _i_MapFilterIterator<CI, FN, PRED, T>(it._it, it._lambda, predicate);
+	}
+
+	template<CustomIterator CI, class FN, class P1, class T, PredicateFunction<T> P2>
+	constexpr auto filter(_i_MapFilterIterator<CI, FN, P1, T> it, P2 lambda) {
+		const auto both = [first = it._predicate, lambda](const T &x) { return first(x) && lambda(x); };
+		return _i_MapFilterIterator<CI, FN, decltype(both), T>(it._it, it._lambda, both);
+	}
+	template<typename FN>
+	struct filter_ {
+		FN _lambda;
+		constexpr explicit filter_(FN lambda) : _lambda(lambda) {}
+	};
+	template<typename FN>
+	constexpr auto filter(FN lambda) {
+		return filter_<FN>(lambda);
+	}
+	template<CustomIterator CI, PredicateFunction<typename CI::value_type> FN>
+	constexpr auto operator|(CI it, filter_<FN> lambda) {
+		return filter(it, lambda._lambda);
+	}
 
-		return _(it, n);
-	}
-	struct take_ {
-		uint64 _n;
-	};
-	constexpr auto take(uint64 n) { return take_{n}; }
+	template<CustomIterator CI>
+	constexpr auto take(CI it, uint64 n) {
+		using T = CI::value_type;
+
+		struct _ : cpp_iterator_adapter<_> {
+			using value_type [[maybe_unused]] = TypeMapper<T>::Type;
+			static constexpr bool costly_count() { return CostlyCount<CI>; }
+
+			CI     _it;
+			uint64 _n;
+
+			constexpr _(CI it, uint64 n) : _it(it), _n(n) {}
+
+			constexpr void operator++() {
+				++_it;
+				--_n;
+			}
+
+			constexpr value_type operator*() const { return *_it; }
+
+			[[nodiscard]] constexpr bool has_next() const { return _it.has_next() && _n > 0; }
+
+			[[nodiscard]] constexpr uint64 count() const
+				requires CountingIterator<CI>
+			{
+				if constexpr (CountingIterator<CI>) { return min(_n, _it.count()); }
+				return _n;
+			}
+
+			constexpr void operator+=(uint64 n)
+				requires RandomAccessIterator<CI>
+			{
+				if constexpr (RandomAccessIterator<CI>) {
+					_it += n;
+					_n -= n;
+				}
+			}
+
+			constexpr value_type peek(uint64 n) const
+				requires RandomAccessIterator<CI>
+			{
+				if constexpr (RandomAccessIterator<CI>) { return _it.peek(n); }
+				return *_it;
+			}
+
+			constexpr block<value_type>
+			next_block(add_pointer_to_removed_reference_t<value_type> buffer, uint64 n)
+				requires BlockIterator<CI>
+			{
+				if constexpr (BlockIterator<CI>) {
+					const block<value_type> result = _it.next_block(buffer, min(n, _n));
+					_n -= result.size;
+					return result;
+				}
+				return {};
+			}
+		};
+
+		return _(it, n);
+	}
+	struct take_ {
+		uint64 _n;
+	};
+	constexpr auto take(uint64 n) { return take_{n}; }
 	template<CustomIterator CI>
 	constexpr auto operator|(CI it, take_ n) {
 		return take(it, n._n);
@@ -576,9 +1247,14 @@ namespace it {
 	 * Or the programmers job to not write it.
 	 *
 	 * This function is a prime example. It's not lazy.
+	 * At least random access iterators skip in O(1), so skip(offset) | take(page) doesn't cost O(offset).
 	 */
 	template<CustomIterator CI>
 	constexpr auto skip(CI it, uint64 n) {
+		if constexpr (RandomAccessIterator<CI>) {
+			it += min(n, it.count());
+			return it;
+		}
 		for (uint64 i = 0; i < n; i++) { ++it; }
 
 		return it;
@@ -626,6 +1302,70 @@ namespace it {
 			{
 				return min(_it_1.count(), _it_2.count());
 			}
+
+			constexpr void operator+=(uint64 n)
+				requires RandomAccessIterator<CI_1> && RandomAccessIterator<CI_2>
+			{
+				if constexpr (RandomAccessIterator<CI_1> && RandomAccessIterator<CI_2>) {
+					_it_1 += n;
+					_it_2 += n;
+				}
+			}
+
+			constexpr pair_t peek(uint64 n) const
+				requires RandomAccessIterator<CI_1> && RandomAccessIterator<CI_2>
+			{
+				if constexpr (RandomAccessIterator<CI_1> && RandomAccessIterator<CI_2>) {
+					return {_it_1.peek(n), _it_2.peek(n)};
+				}
+				return **this;
+			}
+
+			// Positions only line up if both iterators count their elements, so no filters.
+			[[nodiscard]] constexpr uint64 split_size() const
+				requires SplittableIterator<CI_1> && SplittableIterator<CI_2> && CountingIterator<CI_1>
+						 && CountingIterator<CI_2>
+			{
+				return min(_it_1.count(), _it_2.count());
+			}
+
+			[[nodiscard]] constexpr split_pair<_> split_at(uint64 k) const
+				requires SplittableIterator<CI_1> && SplittableIterator<CI_2> && CountingIterator<CI_1>
+						 && CountingIterator<CI_2>
+			{
+				if constexpr (SplittableIterator<CI_1> && SplittableIterator<CI_2>) {
+					const split_pair<CI_1> parts_1 = _it_1.split_at(k);
+					const split_pair<CI_2> parts_2 = _it_2.split_at(k);
+					return {_(parts_1.first, parts_2.first), _(parts_1.second, parts_2.second)};
+				}
+				return {*this, *this};
+			}
+
+			// The second iterator is drained until it matches the first one.
+			// If it runs out first, the first one is advanced too far,
+			// but the zip is exhausted at that point anyway.
+			constexpr block<pair_t> next_block(pair_t *buffer, uint64 n)
+				requires BlockIterator<CI_1> && BlockIterator<CI_2> && BlockValue<pair_t>
+			{
+				if constexpr (BlockIterator<CI_1> && BlockIterator<CI_2> && BlockValue<pair_t>) {
+					typename CI_1::value_type buffer_1[block_size];
+					typename CI_2::value_type buffer_2[block_size];
+
+					const auto block_1 = _it_1.next_block(buffer_1, min(n, block_size));
+
+					uint64 m = 0;
+					while (m < block_1.size) {
+						const auto block_2 = _it_2.next_block(buffer_2 + m, block_1.size - m);
+						if (block_2.size == 0) { break; }
+						for (uint64 i = 0; i < block_2.size; i++) {
+							buffer[m + i] = {block_1.data[m + i], block_2.data[i]};
+						}
+						m += block_2.size;
+					}
+					return {buffer, m};
+				}
+				return {};
+			}
 		};
 
 		return _(it_1, it_2);
@@ -683,6 +1423,51 @@ namespace it {
 			{
 				return _it_1.count() + _it_2.count();
 			}
+
+			constexpr void operator+=(uint64 n)
+				requires RandomAccessIterator<CI_1> && RandomAccessIterator<CI_2>
+			{
+				if constexpr (RandomAccessIterator<CI_1> && RandomAccessIterator<CI_2>) {
+					if (!iterator_in_use) {
+						const uint64 first = _it_1.count();
+						if (n < first) {
+							_it_1 += n;
+							return;
+						}
+						_it_1 += first;
+						iterator_in_use = true;
+						n -= first;
+					}
+					_it_2 += n;
+				}
+			}
+
+			constexpr value_type peek(uint64 n) const
+				requires RandomAccessIterator<CI_1> && RandomAccessIterator<CI_2>
+			{
+				if constexpr (RandomAccessIterator<CI_1> && RandomAccessIterator<CI_2>) {
+					if (iterator_in_use) { return _it_2.peek(n); }
+					const uint64 first = _it_1.count();
+					if (n < first) { return _it_1.peek(n); }
+					return _it_2.peek(n - first);
+				}
+				return **this;
+			}
+
+			constexpr block<value_type>
+			next_block(add_pointer_to_removed_reference_t<value_type> buffer, uint64 n)
+				requires BlockIterator<CI_1> && BlockIterator<CI_2>
+			{
+				if constexpr (BlockIterator<CI_1> && BlockIterator<CI_2>) {
+					if (!iterator_in_use) {
+						const block<value_type> result = _it_1.next_block(buffer, n);
+						if (!_it_1.has_next()) { iterator_in_use = true; }
+						if (result.size != 0) { return result; }
+					}
+					return _it_2.next_block(buffer, n);
+				}
+				return {};
+			}
 		};
 
 		return _(it_1, it_2);
@@ -719,10 +1504,11 @@ namespace it {
 		struct _ : cpp_iterator_adapter<_> {
 			using value_type [[maybe_unused]] = pair_t;
 
-			CI_1 _it_1;
-			CI_1 current_it_1;
-			CI_2 _it_2;
-			T_2  it_value_cache; // it may be expensive to call *_it_2;
+			CI_1   _it_1;
+			CI_1   current_it_1;
+			CI_2   _it_2;
+			T_2    it_value_cache; // it may be expensive to call *_it_2;
+			uint64 _left = 0;      // pairs left, only if counting, it ends the first half of a split
 
 			constexpr _(CI_1 it_1, CI_2 it_2) : _it_1(it_1), current_it_1(it_1), _it_2(it_2) {
 				if (_it_2.has_next()) {
@@ -730,10 +1516,18 @@ namespace it {
 				} else {
 					it_value_cache = undefined<T_2>();
 				}
+				if constexpr (CountingIterator<CI_1> && CountingIterator<CI_2>) {
+					_left = _it_1.count() * _it_2.count();
+				}
 			}
 
 			constexpr void operator++() {
+				if constexpr (CountingIterator<CI_1> && CountingIterator<CI_2>) { --_left; }
 				++current_it_1;
+				next_row();
+			}
+
+			constexpr void next_row() {
 				while (!current_it_1.has_next()) {
 					current_it_1 = _it_1;
 					++_it_2;
@@ -747,12 +1541,90 @@ namespace it {
 
 			constexpr pair_t operator*() const { return {*current_it_1, it_value_cache}; }
 
-			[[nodiscard]] constexpr bool has_next() const { return _it_2.has_next(); }
+			// A block never crosses a row, it is a block of current_it_1 paired with the cached value.
+			constexpr block<pair_t> next_block(pair_t *buffer, uint64 n)
+				requires BlockIterator<CI_1> && BlockValue<pair_t>
+			{
+				if constexpr (BlockIterator<CI_1>) {
+					T_1 inner_buffer[block_size];
+
+					n = min(n, block_size);
+					if constexpr (CountingIterator<CI_1> && CountingIterator<CI_2>) { n = min(n, _left); }
+					uint64 size = 0;
+					while (size == 0 && n != 0 && has_next()) {
+						const auto inner = current_it_1.next_block(inner_buffer, n);
+						for (uint64 i = 0; i < inner.size; i++) {
+							buffer[i] = {inner.data[i], it_value_cache};
+						}
+						size = inner.size;
+						if constexpr (CountingIterator<CI_1> && CountingIterator<CI_2>) { _left -= size; }
+						next_row();
+					}
+					return {buffer, size};
+				}
+				return {buffer, 0};
+			}
+
+			[[nodiscard]] constexpr bool has_next() const {
+				if constexpr (CountingIterator<CI_1> && CountingIterator<CI_2>) { return _left != 0; }
+				return _it_2.has_next();
+			}
 
 			[[nodiscard]] constexpr uint64 count() const
 				requires CountingIterator<CI_1> && CountingIterator<CI_2>
 			{
-				return _it_1.count() * (_it_2.count() - 1) + current_it_1.count();
+				return _left;
+			}
+
+			// The rest of the current row first, then whole rows of _it_1.count() pairs.
+			constexpr void operator+=(uint64 n)
+				requires RandomAccessIterator<CI_1> && RandomAccessIterator<CI_2>
+			{
+				if constexpr (RandomAccessIterator<CI_1> && RandomAccessIterator<CI_2>) {
+					const uint64 row = current_it_1.count();
+					if (n == 0) { return; }
+					_left -= n;
+					if (n < row) {
+						current_it_1 += n;
+						return;
+					}
+					n -= row;
+					const uint64 len = _it_1.count();
+					_it_2 += n / len + 1;
+					current_it_1 = _it_1;
+					current_it_1 += n % len;
+					if (_it_2.has_next()) { it_value_cache = *_it_2; }
+				}
+			}
+
+			constexpr pair_t peek(uint64 n) const
+				requires RandomAccessIterator<CI_1> && RandomAccessIterator<CI_2>
+			{
+				if constexpr (RandomAccessIterator<CI_1> && RandomAccessIterator<CI_2>) {
+					const uint64 row = current_it_1.count();
+					if (n < row) { return {current_it_1.peek(n), it_value_cache}; }
+					n -= row;
+					const uint64 len = _it_1.count();
+					return {_it_1.peek(n % len), _it_2.peek(n / len + 1)};
+				}
+				return **this;
+			}
+
+			// Split by the number of pairs, the first half may end in the middle of a row.
+			[[nodiscard]] constexpr uint64 split_size() const
+				requires RandomAccessIterator<CI_1> && RandomAccessIterator<CI_2>
+			{
+				return _left;
+			}
+
+			[[nodiscard]] constexpr split_pair<_> split_at(uint64 k) const
+				requires RandomAccessIterator<CI_1> && RandomAccessIterator<CI_2>
+			{
+				_ first     = *this;
+				first._left = k;
+				_ second    = *this;
+				second += k;
+				return {first, second};
 			}
 		};
 
@@ -770,9 +1642,10 @@ namespace it {
 		struct _ : cpp_iterator_adapter<_> {
 			using value_type [[maybe_unused]] = pair_t;
 
-			CI _it;
-			CI current_it;
-			T  it_value_cache; // it may be expensive to call *_it;
+			CI     _it;
+			CI     current_it;
+			T      it_value_cache; // it may be expensive to call *_it;
+			uint64 _left = 0;      // pairs left, only if counting, it ends the first half of a split
 
 			explicit constexpr _(CI it) : _it(it), current_it(it) {
 				if (_it.has_next()) {
@@ -780,9 +1653,11 @@ namespace it {
 				} else {
 					it_value_cache = undefined<T>();
 				}
+				if constexpr (CountingIterator<CI>) { _left = _it.count() * (_it.count() + 1) / 2; }
 			}
 
 			constexpr void operator++() {
+				if constexpr (CountingIterator<CI>) { --_left; }
 				++current_it;
 				if (!current_it.has_next()) {
 					++_it;
@@ -793,15 +1668,89 @@ namespace it {
 
 			constexpr pair_t operator*() const { return {*current_it, it_value_cache}; }
 
-			[[nodiscard]] constexpr bool has_next() const { return _it.has_next(); }
+			[[nodiscard]] constexpr bool has_next() const {
+				if constexpr (CountingIterator<CI>) { return _left != 0; }
+				return _it.has_next();
+			}
 
 			[[nodiscard]] constexpr uint64 count() const
 				requires CountingIterator<CI>
 			{
-				const uint64 it_count             = _it.count();
-				const uint64 iteration_in_current = current_it.count();
+				return _left;
+			}
+
+			/*
+			 * The rows after the current one have m - 1, m - 2, ... pairs, with m = _it.count().
+			 * The number of whole rows in n pairs is found by a binary search on these triangular sums.
+			 */
+			static constexpr uint64 whole_rows(uint64 m, uint64 n) {
+				uint64 lo = 0;
+				uint64 hi = m - 1;
+				while (lo < hi) {
+					const uint64 mid = (lo + hi + 1) / 2;
+					if (row_pairs(m, mid) <= n) {
+						lo = mid;
+					} else {
+						hi = mid - 1;
+					}
+				}
+				return lo;
+			}
+			static constexpr uint64 row_pairs(uint64 m, uint64 rows) { return rows * (2 * m - rows - 1) / 2; }
+
+			constexpr void operator+=(uint64 n)
+				requires RandomAccessIterator<CI>
+			{
+				if constexpr (RandomAccessIterator<CI>) {
+					const uint64 row = current_it.count();
+					if (n == 0) { return; }
+					_left -= n;
+					if (n < row) {
+						current_it += n;
+						return;
+					}
+					n -= row;
+					const uint64 m    = _it.count();
+					const uint64 rows = whole_rows(m, n);
+					_it += rows + 1;
+					current_it = _it;
+					current_it += n - row_pairs(m, rows);
+					if (_it.has_next()) { it_value_cache = *_it; }
+				}
+			}
 
-				return it_count * (it_count - 1) / 2 + iteration_in_current;
+			constexpr pair_t peek(uint64 n) const
+				requires RandomAccessIterator<CI>
+			{
+				if constexpr (RandomAccessIterator<CI>) {
+					const uint64 row = current_it.count();
+					if (n < row) { return {current_it.peek(n), it_value_cache}; }
+					n -= row;
+					const uint64 m    = _it.count();
+					const uint64 rows = whole_rows(m, n);
+					return {_it.peek(rows + 1 + n - row_pairs(m, rows)), _it.peek(rows + 1)};
+				}
+				return **this;
+			}
+
+			/*
+			 * Split by the number of pairs, not by rows.
+			 * The rows get shorter, so splitting the rows in half would put 3/4 of the pairs into the first half.
+			 */
+			[[nodiscard]] constexpr uint64 split_size() const
+				requires RandomAccessIterator<CI>
+			{
+				return _left;
+			}
+
+			[[nodiscard]] constexpr split_pair<_> split_at(uint64 k) const
+				requires RandomAccessIterator<CI>
+			{
+				_ first     = *this;
+				first._left = k;
+				_ second    = *this;
+				second += k;
+				return {first, second};
 			}
 		};
 
@@ -814,6 +1763,259 @@ namespace it {
 		return unordered_pairs(it);
 	}
 
+	// Bytes of one tile of the tiled pair adapters, two tiles stay in L2.
+	inline constexpr uint64 pair_tile_bytes = 1 << 16;
+
+	/*
+	 * Visits the pairs tile by tile, a tile of rows of it_2 against a tile of it_1,
+	 * so every element is loaded once per tile and not once per row.
+	 * Only the order of the pairs differs from cross_product/unordered_pairs.
+	 * triangular keeps the pairs with column >= row, like unordered_pairs.
+	 */
+	template<bool triangular, RandomAccessIterator CI_1, RandomAccessIterator CI_2>
+	constexpr auto _i_tiled_pairs(CI_1 it_1, CI_2 it_2, uint64 tile) {
+		using T_1 = CI_1::value_type;
+		using T_2 = CI_2::value_type;
+		struct pair_t {
+			TypeMapper<T_1>::Type first;
+			TypeMapper<T_2>::Type second;
+		};
+
+		struct _ : cpp_iterator_adapter<_> {
+			using value_type [[maybe_unused]] = pair_t;
+
+			CI_1   _it_1;
+			CI_2   _it_2;
+			uint64 _len_1;
+			uint64 _len_2;
+			uint64 _tile;
+			uint64 _row_tile = 0;
+			uint64 _col_tile = 0;
+			uint64 _row      = 0;
+			uint64 _col      = 0;
+			uint64 _col_end  = 0;
+			uint64 _left;
+			T_2    _row_value{};
+
+			constexpr _(CI_1 it_1, CI_2 it_2, uint64 tile)
+				: _it_1(it_1), _it_2(it_2), _len_1(it_1.count()), _len_2(it_2.count()),
+				  _tile(tile == 0 ? 1 : tile),
+				  _left(triangular ? _len_2 * (_len_2 + 1) / 2 : _len_1 * _len_2) {
+				start_row();
+			}
+
+			// A row never leaves the tile, on the diagonal it starts at the row.
+			constexpr void start_row() {
+				_col     = triangular ? max(_col_tile, _row) : _col_tile;
+				_col_end = min(_col_tile + _tile, _len_1);
+				if (_left != 0) { _row_value = _it_2.peek(_row); }
+			}
+
+			constexpr void next_row() {
+				if (++_row < min(_row_tile + _tile, _len_2)) {
+					start_row();
+					return;
+				}
+				_col_tile += _tile;
+				if (_col_tile >= _len_1) {
+					_row_tile += _tile;
+					_col_tile = triangular ? _row_tile : 0;
+				}
+				_row = _row_tile;
+				start_row();
+			}
+
+			constexpr void operator++() {
+				--_left;
+				if (++_col == _col_end) { next_row(); }
+			}
+
+			constexpr pair_t operator*() const { return {_it_1.peek(_col), _row_value}; }
+
+			[[nodiscard]] constexpr bool has_next() const { return _left != 0; }
+
+			[[nodiscard]] constexpr uint64 count() const { return _left; }
+
+			constexpr block<pair_t> next_block(pair_t *buffer, uint64 n)
+				requires BlockValue<pair_t>
+			{
+				const uint64 size = min(min(n, _col_end - _col), _left);
+				for (uint64 i = 0; i < size; i++) { buffer[i] = {_it_1.peek(_col + i), _row_value}; }
+				_left -= size;
+				_col += size;
+				if (size != 0 && _col == _col_end) { next_row(); }
+				return {buffer, size};
+			}
+		};
+
+		return _(it_1, it_2, tile);
+	}
+
+	template<RandomAccessIterator CI_1, RandomAccessIterator CI_2>
+	constexpr auto cross_product_tiled(CI_1 it_1, CI_2 it_2,
+									   uint64 tile = pair_tile_bytes / sizeof(typename CI_1::value_type)) {
+		return _i_tiled_pairs<false>(it_1, it_2, tile);
+	}
+
+	template<RandomAccessIterator CI>
+	constexpr auto unordered_pairs_tiled(CI it, uint64 tile = pair_tile_bytes / sizeof(typename CI::value_type)) {
+		return _i_tiled_pairs<true>(it, it, tile);
+	}
+	struct unordered_pairs_tiled_ {
+		uint64 _tile;
+	};
+	constexpr auto unordered_pairs_tiled(uint64 tile) { return unordered_pairs_tiled_{tile}; }
+	template<RandomAccessIterator CI>
+	constexpr auto operator|(CI it, unordered_pairs_tiled_ tiled) {
+		return unordered_pairs_tiled(it, tiled._tile);
+	}
+
+	/*
+	 * Iterates the iterators lambda returns for the elements of it, one after another.
+	 * The inner iterator is created when the previous one is exhausted and lives inside the adapter,
+	 * it's destroyed and constructed in place, so it doesn't have to be assignable.
+	 * count() calls lambda for the remaining elements of it, but doesn't iterate the inner iterators.
+	 */
+	template<CustomIterator CI, class FN>
+		requires CustomIterator<decltype(_declare_val<FN>()(*_declare_val<CI>()))>
+	constexpr auto flat_map(CI it, FN lambda) {
+		using INNER = decltype(lambda(*it));
+		using T     = INNER::value_type;
+
+		struct _ : cpp_iterator_adapter<_> {
+			using value_type [[maybe_unused]] = T;
+			static constexpr bool costly_count() { return true; }
+
+			union storage {
+				INNER inner;
+				constexpr storage() {}
+				constexpr ~storage() {}
+			};
+
+			CI      _it;
+			FN      _lambda;
+			storage _storage;
+			bool    _active = false; // _storage.inner is alive and not exhausted, false at the end
+
+			constexpr _(CI it, FN lambda) : _it(it), _lambda(lambda) { next_inner(); }
+
+			constexpr _(const _ &other) : _it(other._it), _lambda(other._lambda), _active(other._active) {
+				if (_active) { _i_construct_at(&_storage.inner, other._storage.inner); }
+			}
+
+			_ &operator=(const _ &) = delete;
+
+			constexpr ~_() {
+				if (_active) { _storage.inner.~INNER(); }
+			}
+
+			// Skips exhausted and empty inner iterators.
+			constexpr void next_inner() {
+				while (!_active || !_storage.inner.has_next()) {
+					if (_active) {
+						_storage.inner.~INNER();
+						_active = false;
+						++_it;
+					}
+					if (!_it.has_next()) { return; }
+					_i_construct_at(&_storage.inner, _lambda(*_it));
+					_active = true;
+				}
+			}
+
+			constexpr void operator++() {
+				++_storage.inner;
+				next_inner();
+			}
+
+			constexpr value_type operator*() const { return *_storage.inner; }
+
+			[[nodiscard]] constexpr bool has_next() const { return _active; }
+
+			[[nodiscard]] constexpr uint64 count() const
+				requires CountingIterator<INNER>
+			{
+				if constexpr (CountingIterator<INNER>) {
+					if (!_active) { return 0; }
+					uint64 n    = _storage.inner.count();
+					CI     rest = _it;
+					for (++rest; rest.has_next(); ++rest) { n += _lambda(*rest).count(); }
+					return n;
+				}
+				return 0;
+			}
+
+			/*
+			 * A block never crosses two inner iterators.
+			 * The last block of an inner iterator may point into it, so it's copied before the iterator is destroyed.
+			 */
+			constexpr block<T> next_block(T *buffer, uint64 n)
+				requires BlockIterator<INNER>
+			{
+				block<T> result = {buffer, 0};
+				if constexpr (BlockIterator<INNER>) {
+					while (result.size == 0 && n != 0 && _active) {
+						result = _storage.inner.next_block(buffer, n);
+						if (!_storage.inner.has_next()) {
+							if (result.data != buffer) {
+								for (uint64 i = 0; i < result.size; i++) { buffer[i] = result.data[i]; }
+								result.data = buffer;
+							}
+							next_inner();
+						}
+					}
+				}
+				return result;
+			}
+		};
+
+		return _(it, lambda);
+	}
+	template<typename FN>
+	struct flat_map_ {
+		FN _lambda;
+		constexpr explicit flat_map_(FN lambda) : _lambda(lambda) {}
+	};
+	template<typename FN>
+	constexpr auto flat_map(FN lambda) {
+		return flat_map_<FN>(lambda);
+	}
+	template<CustomIterator CI, class FN>
+		requires CustomIterator<decltype(_declare_val<FN>()(*_declare_val<CI>()))>
+	constexpr auto operator|(CI it, flat_map_<FN> lambda) {
+		return flat_map(it, lambda._lambda);
+	}
+
+	// An iterator over iterators, iterated one after another.
+	template<CustomIterator CI>
+		requires CustomIterator<typename CI::value_type>
+	constexpr auto flatten(CI it) {
+		return flat_map(it, [](CI::value_type inner) { return inner; });
+	}
+	struct flatten_ {};
+	constexpr auto flatten() { return flatten_{}; }
+	template<CustomIterator CI>
+		requires CustomIterator<typename CI::value_type>
+	constexpr auto operator|(CI it, flatten_) {
+		return flatten(it);
+	}
+
+	template<SplittableIterator CI>
+	constexpr auto split_at(CI it, uint64 k) {
+		return it.split_at(k);
+	}
+
+	template<SplittableIterator CI>
+	constexpr auto split_half(CI it) {
+		return it.split_at(it.split_size() / 2);
+	}
+	struct split_half_ {};
+	constexpr auto split_half() { return split_half_{}; }
+	template<SplittableIterator CI>
+	constexpr auto operator|(CI it, split_half_) {
+		return split_half(it);
+	}
+
 	template<ReverseIterator CI>
 	constexpr auto reverse(CI it) {
 		return it.reverse();
@@ -837,6 +2039,14 @@ namespace algo {
 					  "The iterator value type must be the same as the first "
 					  "argument of the function.");
 		OUT acc = initial;
+		if constexpr (it::BlockIterator<CI>) {
+			typename CI::value_type buffer[it::block_size];
+			for (auto b = it.next_block(buffer, it::block_size); b.size != 0;
+				 b      = it.next_block(buffer, it::block_size)) {
+				for (uint64 i = 0; i < b.size; i++) { acc = func(acc, b.data[i]); }
+			}
+			return acc;
+		}
 		while (it.has_next()) {
 			acc = func(acc, *it);
 			++it;
@@ -863,15 +2073,294 @@ namespace algo {
 		return reduce(it, initial._func, initial._initial);
 	}
 
-	template<typename E>
-	constexpr auto sum() {
-		return reduce(E(0), [](E a, E b) { return a + b; });
+	/*
+	 * sum<OUT>(it) accumulates in OUT, e.g. sum<int64>(it) over int32 elements widens into 64-bit lanes.
+	 * Arithmetic block iterators use the vectorized kernels in simd.h.
+	 * Floating point sums are computed pairwise, so the result doesn't depend on -ffast-math.
+	 */
+	template<typename OUT, it::CustomIterator CI>
+	constexpr OUT sum(CI it) {
+		using E = typename CI::value_type;
+		// Summing zeros instead of the rejected elements is cheaper than compacting the block.
+		if constexpr (it::SelectionIterator<CI> && simd::Arithmetic<E> && simd::Arithmetic<OUT>) {
+			E     buffer[it::block_size];
+			E     masked[it::block_size];
+			uint8 selected[it::block_size];
+			if constexpr (simd::Float<OUT>) {
+				simd::pairwise_accumulator<OUT> acc;
+				for (auto s = it.next_selection(buffer, selected, it::block_size); s.size != 0;
+					 s      = it.next_selection(buffer, selected, it::block_size)) {
+					simd::zero_unselected(s.data, s.size, s.selected, masked);
+					acc.add(simd::sum<OUT>(masked, s.size));
+				}
+				return acc.result();
+			}
+			if constexpr (simd::Integer<OUT>) {
+				simd::unsigned_t<OUT> acc = 0;
+				for (auto s = it.next_selection(buffer, selected, it::block_size); s.size != 0;
+					 s      = it.next_selection(buffer, selected, it::block_size)) {
+					simd::zero_unselected(s.data, s.size, s.selected, masked);
+					acc += simd::unsigned_t<OUT>(simd::sum<OUT>(masked, s.size));
+				}
+				return OUT(acc);
+			}
+		}
+		if constexpr (it::BlockIterator<CI> && simd::Arithmetic<E> && simd::Arithmetic<OUT>) {
+			E buffer[it::block_size];
+			if constexpr (simd::Float<OUT>) {
+				simd::pairwise_accumulator<OUT> acc;
+				for (auto b = it.next_block(buffer, it::block_size); b.size != 0;
+					 b      = it.next_block(buffer, it::block_size)) {
+					acc.add(simd::sum<OUT>(b.data, b.size));
+				}
+				return acc.result();
+			}
+			if constexpr (simd::Integer<OUT>) {
+				simd::unsigned_t<OUT> acc = 0;
+				for (auto b = it.next_block(buffer, it::block_size); b.size != 0;
+					 b      = it.next_block(buffer, it::block_size)) {
+					acc += simd::unsigned_t<OUT>(simd::sum<OUT>(b.data, b.size));
+				}
+				return OUT(acc);
+			}
+		}
+		if constexpr (it::is_same_v<E, OUT>) {
+			return reduce(it, [](E a, E b) { return a + b; }, E(0));
+		}
+		OUT acc = OUT(0);
+		while (it.has_next()) {
+			acc = acc + OUT(*it);
+			++it;
+		}
+		return acc;
 	}
 
 	template<it::CustomIterator CI>
 	constexpr auto sum(CI it) {
 		using E = typename CI::value_type;
-		return reduce(it, [](E a, E b) { return a + b; }, E(0));
+		return sum<E>(it);
+	}
+
+	template<typename OUT>
+	struct sum_ {};
+	template<typename OUT>
+	constexpr auto sum() {
+		return sum_<OUT>{};
+	}
+	template<it::CustomIterator CI, typename OUT>
+	constexpr auto operator|(CI it, sum_<OUT>) {
+		return sum<OUT>(it);
+	}
+
+	template<typename OUT>
+	struct scan_result {
+		uint64 count; // elements written
+		OUT    total; // the initial value combined with all elements
+	};
+
+	// The scan of one block, out may be data.
+	template<bool inclusive, typename T, typename OUT, class OP>
+	constexpr OUT _i_scan_block(const T *data, uint64 n, OUT *out, OUT acc, OP op) {
+		if constexpr (it::is_same_v<OP, it::_i_plus> && simd::Integer<T> && simd::Integer<OUT>) {
+			return simd::prefix_sum<inclusive>(data, n, out, acc);
+		} else {
+			for (uint64 i = 0; i < n; i++) {
+				const T e = data[i];
+				if constexpr (!inclusive) { out[i] = acc; }
+				acc = op(acc, e);
+				if constexpr (inclusive) { out[i] = acc; }
+			}
+			return acc;
+		}
+	}
+
+	template<bool inclusive, it::CustomIterator CI, typename OUT, class OP>
+	constexpr scan_result<OUT> _i_scan_into(CI it, OUT *out, OUT init, OP op) {
+		using T        = typename CI::value_type;
+		uint64 written = 0;
+		OUT    acc     = init;
+		if constexpr (it::BlockIterator<CI>) {
+			T buffer[it::block_size];
+			for (auto b = it.next_block(buffer, it::block_size); b.size != 0;
+				 b      = it.next_block(buffer, it::block_size)) {
+				acc = _i_scan_block<inclusive>(b.data, b.size, out + written, acc, op);
+				written += b.size;
+			}
+		} else {
+			while (it.has_next()) {
+				const T e = *it;
+				if constexpr (!inclusive) { out[written] = acc; }
+				acc = op(acc, e);
+				if constexpr (inclusive) { out[written] = acc; }
+				written++;
+				++it;
+			}
+		}
+		return {written, acc};
+	}
+
+	/*
+	 * Running accumulations written to out, which needs room for every element.
+	 * The inclusive scan writes op(init, e_0), op(op(init, e_0), e_1), ..., the exclusive one starts with init
+	 * and leaves out the last element, e.g. counts to offsets.
+	 * Integer sums are computed block by block in vector registers, see simd::prefix_sum.
+	 */
+	template<it::CustomIterator CI, typename OUT, class OP = it::_i_plus>
+	constexpr scan_result<OUT> inclusive_scan_into(CI it, OUT *out, OUT init = OUT(), OP op = {}) {
+		return _i_scan_into<true>(it, out, init, op);
+	}
+	template<it::CustomIterator CI, typename OUT, class OP = it::_i_plus>
+	constexpr scan_result<OUT> exclusive_scan_into(CI it, OUT *out, OUT init = OUT(), OP op = {}) {
+		return _i_scan_into<false>(it, out, init, op);
+	}
+
+	template<bool inclusive, typename OUT, class OP>
+	struct scan_into_ {
+		OUT *_out;
+		OUT  _init;
+		OP   _op;
+	};
+	template<typename OUT, class OP = it::_i_plus>
+	constexpr auto inclusive_scan_into(OUT *out, OUT init = OUT(), OP op = {}) {
+		return scan_into_<true, OUT, OP>{out, init, op};
+	}
+	template<typename OUT, class OP = it::_i_plus>
+	constexpr auto exclusive_scan_into(OUT *out, OUT init = OUT(), OP op = {}) {
+		return scan_into_<false, OUT, OP>{out, init, op};
+	}
+	template<it::CustomIterator CI, bool inclusive, typename OUT, class OP>
+	constexpr auto operator|(CI it, scan_into_<inclusive, OUT, OP> scan) {
+		return _i_scan_into<inclusive>(it, scan._out, scan._init, scan._op);
+	}
+
+	/*
+	 * min, max, minmax and argmin require a non-empty iterator.
+	 * Ties keep the earlier element, argmin returns the position of the first minimum.
+	 */
+	template<it::CustomIterator CI>
+	constexpr auto min(CI it) {
+		using E  = it::remove_reference_t<typename CI::value_type>;
+		E result = *it;
+		if constexpr (it::BlockIterator<CI> && simd::Arithmetic<E>) {
+			E buffer[it::block_size];
+			for (auto b = it.next_block(buffer, it::block_size); b.size != 0;
+				 b      = it.next_block(buffer, it::block_size)) {
+				result = simd::min_op(result, simd::min(b.data, b.size));
+			}
+			return result;
+		}
+		++it;
+		while (it.has_next()) {
+			result = simd::min_op<E>(result, *it);
+			++it;
+		}
+		return result;
+	}
+	struct min_ {};
+	constexpr auto min() { return min_{}; }
+	template<it::CustomIterator CI>
+	constexpr auto operator|(CI it, min_) {
+		return min(it);
+	}
+
+	template<it::CustomIterator CI>
+	constexpr auto max(CI it) {
+		using E  = it::remove_reference_t<typename CI::value_type>;
+		E result = *it;
+		if constexpr (it::BlockIterator<CI> && simd::Arithmetic<E>) {
+			E buffer[it::block_size];
+			for (auto b = it.next_block(buffer, it::block_size); b.size != 0;
+				 b      = it.next_block(buffer, it::block_size)) {
+				result = simd::max_op(result, simd::max(b.data, b.size));
+			}
+			return result;
+		}
+		++it;
+		while (it.has_next()) {
+			result = simd::max_op<E>(result, *it);
+			++it;
+		}
+		return result;
+	}
+	struct max_ {};
+	constexpr auto max() { return max_{}; }
+	template<it::CustomIterator CI>
+	constexpr auto operator|(CI it, max_) {
+		return max(it);
+	}
+
+	template<typename T>
+	using minmax_t = simd::minmax_pair<T>;
+
+	template<it::CustomIterator CI>
+	constexpr auto minmax(CI it) {
+		using E         = it::remove_reference_t<typename CI::value_type>;
+		minmax_t<E> acc = {*it, *it};
+		if constexpr (it::BlockIterator<CI> && simd::Arithmetic<E>) {
+			E buffer[it::block_size];
+			for (auto b = it.next_block(buffer, it::block_size); b.size != 0;
+				 b      = it.next_block(buffer, it::block_size)) {
+				const minmax_t<E> block_acc = simd::minmax(b.data, b.size);
+				acc.min                     = simd::min_op(acc.min, block_acc.min);
+				acc.max                     = simd::max_op(acc.max, block_acc.max);
+			}
+			return acc;
+		}
+		++it;
+		while (it.has_next()) {
+			const E element = *it;
+			acc.min         = simd::min_op(acc.min, element);
+			acc.max         = simd::max_op(acc.max, element);
+			++it;
+		}
+		return acc;
+	}
+	struct minmax_ {};
+	constexpr auto minmax() { return minmax_{}; }
+	template<it::CustomIterator CI>
+	constexpr auto operator|(CI it, minmax_) {
+		return minmax(it);
+	}
+
+	/*
+	 * The block path first finds the minimum of a block with the vector kernel.
+	 * Only if it improves on the current minimum, the block, which is still in L1, is searched for its position.
+	 */
+	template<it::CustomIterator CI>
+	constexpr uint64 argmin(CI it) {
+		using E         = it::remove_reference_t<typename CI::value_type>;
+		E      best     = *it;
+		uint64 best_idx = 0;
+		uint64 offset   = 0;
+		if constexpr (it::BlockIterator<CI> && simd::Arithmetic<E>) {
+			E buffer[it::block_size];
+			for (auto b = it.next_block(buffer, it::block_size); b.size != 0;
+				 b      = it.next_block(buffer, it::block_size)) {
+				const E block_min = simd::min(b.data, b.size);
+				if (block_min < best) {
+					best     = block_min;
+					best_idx = offset + simd::find(b.data, b.size, block_min);
+				}
+				offset += b.size;
+			}
+			return best_idx;
+		}
+		while (it.has_next()) {
+			const E element = *it;
+			if (element < best) {
+				best     = element;
+				best_idx = offset;
+			}
+			offset++;
+			++it;
+		}
+		return best_idx;
+	}
+	struct argmin_ {};
+	constexpr auto argmin() { return argmin_{}; }
+	template<it::CustomIterator CI>
+	constexpr auto operator|(CI it, argmin_) {
+		return argmin(it);
 	}
 
 	template<it::CustomIterator CI>
@@ -892,12 +2381,66 @@ namespace algo {
 	}
 
 
+	/*
+	 * Position of the first element equal to value, the number of elements if there is none.
+	 * Iterators with their own find, like the c_string_iterator, use it.
+	 */
+	template<it::CustomIterator CI>
+	constexpr uint64 find(CI it, typename CI::value_type value) {
+		if constexpr (requires { { it.find(value) } -> it::same_as<uint64>; }) { return it.find(value); }
+		uint64 offset = 0;
+		if constexpr (it::BlockIterator<CI>) {
+			typename CI::value_type buffer[it::block_size];
+			for (auto b = it.next_block(buffer, it::block_size); b.size != 0;
+				 b      = it.next_block(buffer, it::block_size)) {
+				const uint64 index = simd::find(b.data, b.size, value);
+				if (index != b.size) { return offset + index; }
+				offset += b.size;
+			}
+			return offset;
+		}
+		while (it.has_next() && !(*it == value)) {
+			offset++;
+			++it;
+		}
+		return offset;
+	}
+	template<typename T>
+	struct find_ {
+		T _value;
+	};
+	template<typename T>
+	constexpr auto find(T value) {
+		return find_<T>{value};
+	}
+	template<it::CustomIterator CI, typename T>
+	constexpr auto operator|(CI it, find_<T> value) {
+		return find(it, typename CI::value_type(value._value));
+	}
+
 	template<it::CustomIterator CI>
 	constexpr uint64 count(CI it) {
 #if !defined(__clang__) || defined(__GNUC__)
 		if constexpr (it::CountingIterator<CI>) { return it.count(); }
 #endif
 		uint64 acc = 0;
+		if constexpr (it::SelectionIterator<CI>) {
+			typename CI::value_type buffer[it::block_size];
+			uint8                   selected[it::block_size];
+			for (auto s = it.next_selection(buffer, selected, it::block_size); s.size != 0;
+				 s      = it.next_selection(buffer, selected, it::block_size)) {
+				acc += simd::count_selected(s.selected, s.size);
+			}
+			return acc;
+		}
+		if constexpr (it::BlockIterator<CI>) {
+			typename CI::value_type buffer[it::block_size];
+			for (auto b = it.next_block(buffer, it::block_size); b.size != 0;
+				 b      = it.next_block(buffer, it::block_size)) {
+				acc += b.size;
+			}
+			return acc;
+		}
 		while (it.has_next()) {
 			acc++;
 			++it;
@@ -921,6 +2464,21 @@ namespace algo {
 	constexpr T to_array(CI it) {
 		static_assert(it::is_same_v<typename T::value_type, typename CI::value_type>);
 		T arr;
+		if constexpr (it::CheapCountingIterator<CI> && requires(uint64 n) { arr.reserve(n); }) {
+			arr.reserve(it.count());
+		}
+		if constexpr (it::BlockIterator<CI>) {
+			typename CI::value_type buffer[it::block_size];
+			for (auto b = it.next_block(buffer, it::block_size); b.size != 0;
+				 b      = it.next_block(buffer, it::block_size)) {
+				if constexpr (requires { arr.insert(arr.end(), b.data, b.data + b.size); }) {
+					arr.insert(arr.end(), b.data, b.data + b.size);
+				} else {
+					for (uint64 i = 0; i < b.size; i++) { arr.push_back(b.data[i]); }
+				}
+			}
+			return arr;
+		}
 		while (it.has_next()) {
 			arr.push_back(*it);
 			++it;
@@ -931,40 +2489,80 @@ namespace algo {
 } // namespace algo
 
 namespace it {
-	template<CustomIterator CI>
+	/*
+	 * Recount iterates a copy on every call of count(), which easily turns an O(n) algorithm into O(n^2).
+	 * Eager counts once on construction, Lazy on the first call of count(),
+	 * afterwards both decrement the count on every increment.
+	 * The lazy count is cached in a mutable member, so don't call count() on the same wrapper concurrently.
+	 */
+	enum class CountMode {
+		Recount,
+		Eager,
+		Lazy,
+	};
+
+	template<CountMode mode = CountMode::Lazy, CustomIterator CI>
 	constexpr auto counted_wrapper(CI it) {
 		using T = CI::value_type;
 		struct _ : cpp_iterator_adapter<_> {
 			using value_type [[maybe_unused]] = TypeMapper<T>::Type;
+			static constexpr bool costly_count() { return CostlyCount<CI>; }
 
-			CI _it;
+			CI             _it;
+			mutable uint64 _count   = 0;
+			mutable bool   _counted = false;
 
-			constexpr void operator++() { ++_it; }
+			explicit constexpr _(CI it) : _it(it) {
+				if constexpr (mode == CountMode::Eager && !CountingIterator<CI>) {
+					_count   = algo::count(_it);
+					_counted = true;
+				}
+			}
+
+			constexpr void operator++() {
+				++_it;
+				if constexpr (mode != CountMode::Recount && !CountingIterator<CI>) {
+					if (_counted) { --_count; }
+				}
+			}
 
 			constexpr value_type operator*() const { return *_it; }
 
 			[[nodiscard]] constexpr bool has_next() const { return _it.has_next(); }
 
-			[[nodiscard]] constexpr uint64 count() const
-				requires(!CountingIterator<CI>)
-			{
-				CI copy = _it;
-				return algo::count(copy);
+			[[nodiscard]] constexpr uint64 count() const {
+				if constexpr (CountingIterator<CI>) { return _it.count(); }
+				if constexpr (mode == CountMode::Recount) { return algo::count(_it); }
+				if (!_counted) {
+					_count   = algo::count(_it);
+					_counted = true;
+				}
+				return _count;
 			}
 
-			[[nodiscard]] constexpr uint64 count() const
-				requires(CountingIterator<CI>)
+			constexpr block<value_type>
+			next_block(add_pointer_to_removed_reference_t<value_type> buffer, uint64 n)
+				requires BlockIterator<CI>
 			{
-				return _it.count();
+				if constexpr (BlockIterator<CI>) {
+					const block<value_type> result = _it.next_block(buffer, n);
+					if (_counted) { _count -= result.size; }
+					return result;
+				}
+				return {};
 			}
 		};
-		return _{it};
+		return _(it);
 	}
+	template<CountMode mode>
 	struct counted_wrapper_ {};
-	constexpr auto counted_wrapper() { return counted_wrapper_{}; }
-	template<CustomIterator CI>
-	constexpr auto operator|(CI it, counted_wrapper_) {
-		return counted_wrapper(it);
+	template<CountMode mode = CountMode::Lazy>
+	constexpr auto counted_wrapper() {
+		return counted_wrapper_<mode>{};
+	}
+	template<CustomIterator CI, CountMode mode>
+	constexpr auto operator|(CI it, counted_wrapper_<mode>) {
+		return counted_wrapper<mode>(it);
 	}
 
 	/*
@@ -979,6 +2577,7 @@ namespace it {
 		using T = CI::value_type;
 		struct _ : cpp_iterator_adapter<_> {
 			using value_type [[maybe_unused]] = TypeMapper<T>::Type;
+			static constexpr bool costly_count() { return CostlyCount<CI>; }
 
 			CI _it;
 			T  cache;
@@ -1012,6 +2611,144 @@ namespace it {
 	constexpr auto operator|(CI it, caching_iterator_) {
 		return caching_iterator(it);
 	}
+
+	/*
+	 * Running accumulations: op(init, e_0), op(op(init, e_0), e_1), ...
+	 * *it combines the accumulation so far with the current element, so it costs one call of op.
+	 * Blocks are scanned as a whole, integer sums in vector registers.
+	 */
+	template<CustomIterator CI, typename OUT, class OP = _i_plus>
+	constexpr auto scan(CI it, OUT init, OP op = {}) {
+		struct _ : cpp_iterator_adapter<_> {
+			using value_type [[maybe_unused]] = OUT;
+			static constexpr bool costly_count() { return CostlyCount<CI>; }
+
+			CI  _it;
+			OUT _acc; // the elements before the current one
+			OP  _op;
+
+			constexpr _(CI it, OUT init, OP op) : _it(it), _acc(init), _op(op) {}
+
+			constexpr void operator++() {
+				_acc = _op(_acc, *_it);
+				++_it;
+			}
+
+			constexpr value_type operator*() const { return _op(_acc, *_it); }
+
+			[[nodiscard]] constexpr bool has_next() const { return _it.has_next(); }
+
+			[[nodiscard]] constexpr uint64 count() const
+				requires CountingIterator<CI>
+			{
+				if constexpr (CountingIterator<CI>) { return _it.count(); }
+				return 0;
+			}
+
+			constexpr block<OUT> next_block(OUT *buffer, uint64 n)
+				requires BlockIterator<CI> && BlockValue<OUT>
+			{
+				if constexpr (BlockIterator<CI> && BlockValue<OUT>) {
+					typename CI::value_type in[block_size];
+					const auto              b = _it.next_block(in, min(n, block_size));
+					_acc = algo::_i_scan_block<true>(b.data, b.size, buffer, _acc, _op);
+					return {buffer, b.size};
+				}
+				return {};
+			}
+		};
+		return _(it, init, op);
+	}
+	template<typename OUT, class OP>
+	struct scan_ {
+		OUT _init;
+		OP  _op;
+	};
+	template<typename OUT, class OP = _i_plus>
+		requires(!CustomIterator<OUT>)
+	constexpr auto scan(OUT init, OP op = {}) {
+		return scan_<OUT, OP>{init, op};
+	}
+	template<CustomIterator CI, typename OUT, class OP>
+	constexpr auto operator|(CI it, scan_<OUT, OP> scan_op) {
+		return scan(it, scan_op._init, scan_op._op);
+	}
+
+	/*
+	 * Type erased iterator for pipelines that are composed at runtime, e.g. filters chosen by a query.
+	 * The wrapped iterator is stored in place, there is no allocation.
+	 * It must fit into BufferSize bytes and be trivially copyable, otherwise the constructor doesn't exist.
+	 * Wrapping an any_iterator into another stage needs a larger BufferSize for the outer one.
+	 *
+	 * Every call goes through a table of function pointers.
+	 * next_n(out, n) copies up to n elements per call, so consumers of the block protocol
+	 * pay for the dispatch once per block instead of once per element.
+	 */
+	template<typename T, uint64 BufferSize = 64>
+	struct any_iterator : cpp_iterator_adapter<any_iterator<T, BufferSize>> {
+		using value_type [[maybe_unused]] = T;
+
+		struct vtable {
+			void (*increment)(void *);
+			T (*dereference)(const void *);
+			bool (*has_next)(const void *);
+			uint64 (*next_n)(void *, T *, uint64);
+		};
+
+		template<CustomIterator CI>
+		static uint64 next_n_of(void *storage, T *out, uint64 n) {
+			CI    &it      = *static_cast<CI *>(storage);
+			uint64 written = 0;
+			if constexpr (BlockIterator<CI> && is_same_v<typename CI::value_type, T>) {
+				while (written < n) {
+					const block<T> b = it.next_block(out + written, n - written);
+					if (b.size == 0) { break; }
+					if (b.data != out + written) {
+						for (uint64 i = 0; i < b.size; i++) { out[written + i] = b.data[i]; }
+					}
+					written += b.size;
+				}
+				return written;
+			}
+			while (written < n && it.has_next()) {
+				out[written++] = *it;
+				++it;
+			}
+			return written;
+		}
+
+		template<CustomIterator CI>
+		static constexpr vtable vtable_of = {
+				[](void *storage) { ++*static_cast<CI *>(storage); },
+				[](const void *storage) { return T(**static_cast<const CI *>(storage)); },
+				[](const void *storage) { return static_cast<const CI *>(storage)->has_next(); },
+				next_n_of<CI>,
+		};
+
+		alignas(16) unsigned char _storage[BufferSize];
+		const vtable *_vtable;
+
+		template<CustomIterator CI>
+			requires(!is_same_v<CI, any_iterator> && ConvertibleTo<typename CI::value_type, T>
+					 && TriviallyCopyable<CI> && sizeof(CI) <= BufferSize && alignof(CI) <= 16)
+		any_iterator(CI it) : _vtable(&vtable_of<CI>) { // NOLINT(*-explicit-constructor)
+			__builtin_memcpy(_storage, &it, sizeof(CI));
+		}
+
+		void operator++() { _vtable->increment(_storage); }
+
+		T operator*() const { return _vtable->dereference(_storage); }
+
+		[[nodiscard]] bool has_next() const { return _vtable->has_next(_storage); }
+
+		uint64 next_n(T *out, uint64 n) { return _vtable->next_n(_storage, out, n); }
+
+		block<T> next_block(T *buffer, uint64 n)
+			requires BlockValue<T>
+		{
+			return {buffer, next_n(buffer, n)};
+		}
+	};
 } // namespace it
 
 
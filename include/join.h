@@ -0,0 +1,367 @@
+//
+// Created by af on 16/10/26.
+//
+
+#ifndef D_ITERATOR_JOIN_H
+#define D_ITERATOR_JOIN_H
+
+#include "group_by.h"
+
+/*
+ * Equi-joins of a probe iterator against a build iterator in O(n + m), instead of cross_product | filter.
+ * The build side is read once into an algo::flat_table in an arena, the probe side is streamed lazily.
+ *
+ * The probe side is looked up in batches: the keys and hashes of a batch are computed first,
+ * then their buckets and the groups the buckets point to are prefetched, so the cache misses of a batch overlap.
+ * The control bytes are the pre-filter, a key without a match almost always fails at the 7 bit tags
+ * of its bucket and never touches the groups or the build rows.
+ *
+ * The iterators keep a batch of matches, so they are positioned at a match like a filter.
+ * Splitting restarts at the current batch, parallel algorithms split before consuming anything.
+ */
+namespace it {
+
+	inline constexpr uint64 join_batch = 64;
+
+	template<typename B, typename P>
+	struct join_pair {
+		B build;
+		P probe;
+	};
+
+	// Up to n elements, n <= block_size, directly from a block iterator.
+	template<CustomIterator CI>
+	constexpr block<typename CI::value_type> _i_next_batch(CI &it, typename CI::value_type *buffer,
+														   uint64 n) {
+		if constexpr (BlockIterator<CI>) { return it.next_block(buffer, n); }
+		uint64 m = 0;
+		for (; m < n && it.has_next(); m++) {
+			buffer[m] = *it;
+			++it;
+		}
+		return {buffer, m};
+	}
+
+	// found[i] is the group of the key of data[i] or nullptr, n <= block_size.
+	template<typename E, class KEY_FN, typename K, typename A>
+	void _i_lookup_batch(const algo::flat_table<K, A> &table, KEY_FN key_fn, const E *data, uint64 n,
+						 algo::group<K, A> **found) {
+		K      keys[block_size];
+		uint64 hashes[block_size];
+		for (uint64 i = 0; i < n; i++) {
+			keys[i]   = key_fn(data[i]);
+			hashes[i] = table.hash_of(keys[i]);
+		}
+		for (uint64 i = 0; i < n; i++) { table.prefetch(hashes[i]); }
+		for (uint64 i = 0; i < n; i++) { table.prefetch_candidate(hashes[i]); }
+		for (uint64 i = 0; i < n; i++) { found[i] = table.find(keys[i], hashes[i]); }
+	}
+
+	// The first and last build row of a key, the rows in between are linked by _i_join_table::_next.
+	struct _i_row_chain {
+		uint32 first;
+		uint32 last;
+	};
+
+	/*
+	 * The build rows are collected once and inserted in blocks, with the keys and hashes of a block
+	 * computed and their buckets prefetched first. The table is sized for all rows up front, so it never grows.
+	 * The rows of a key are chained in their order, a key with one row never reads the chain.
+	 * If the arena runs out of memory, the build side is incomplete and a.failed() is set.
+	 */
+	template<TriviallyCopyable K, TriviallyCopyable B>
+	struct _i_join_table {
+		algo::flat_table<K, _i_row_chain> _table;
+		const B                          *_rows = nullptr;
+		const uint32                     *_next = nullptr;
+
+		template<CustomIterator CI, class KEY_FN>
+		_i_join_table(CI build, KEY_FN key_fn, arena &a)
+			: _i_join_table(algo::collect_into(build, a), key_fn, a) {}
+
+		template<class KEY_FN>
+		_i_join_table(it::iterator<B> input, KEY_FN key_fn, arena &a) : _table(a, input.count()) {
+			const uint64 n    = input.count();
+			const B     *rows = input.data();
+			uint32      *next = a.allocate<uint32>(n);
+			if (n == 0 || next == nullptr) {
+				_table._size = 0;
+				return;
+			}
+
+			K      keys[block_size];
+			uint64 hashes[block_size];
+			for (uint64 start = 0; start < n; start += block_size) {
+				const uint64 size = min(block_size, n - start);
+				for (uint64 i = 0; i < size; i++) {
+					keys[i]   = key_fn(rows[start + i]);
+					hashes[i] = _table.hash_of(keys[i]);
+				}
+				for (uint64 i = 0; i < size; i++) { _table.prefetch(hashes[i]); }
+				for (uint64 i = 0; i < size; i++) {
+					const uint32 row   = uint32(start + i);
+					const uint64 count = _table.count();
+					auto        *g     = _table.insert(keys[i], hashes[i], {row, row});
+					if (g == nullptr) {
+						_table._size = 0;
+						return;
+					}
+					if (_table.count() == count) {
+						next[g->value.last] = row;
+						g->value.last       = row;
+					}
+				}
+			}
+			_rows = rows;
+			_next = next;
+		}
+	};
+
+	template<TriviallyCopyable K, CustomIterator CI, class KEY_FN>
+	algo::flat_table<K, uint8> _i_key_set(CI build, KEY_FN key_fn, arena &a) {
+		uint64 expected = 0;
+		if constexpr (CheapCountingIterator<CI>) { expected = build.count(); }
+		algo::flat_table<K, uint8> keys(a, expected);
+		const auto none = algo::aggregate(uint8(0), [](uint8 acc, auto) { return acc; });
+		algo::_i_group_into(build, key_fn, none, keys);
+		return keys;
+	}
+
+	// Every probe element with every build row of the same key, in the order of the probe side.
+	template<CustomIterator CI, class KEY_FN, TriviallyCopyable K, TriviallyCopyable B>
+		requires BlockValue<typename CI::value_type>
+	struct _i_HashJoinIterator : cpp_iterator_adapter<_i_HashJoinIterator<CI, KEY_FN, K, B>> {
+		using P          = typename CI::value_type;
+		using value_type = join_pair<B, P>;
+
+		CI                  _start; // the probe side at the start of the batch
+		CI                  _it;
+		KEY_FN              _key_fn;
+		_i_join_table<K, B> _table;
+		P                   _batch[join_batch]; // the probe elements of the batch with a match
+		_i_row_chain        _chains[join_batch];
+		uint64              _batch_size = 0;
+		uint64              _batch_pos  = 0;
+		uint32              _row        = 0; // of the current probe element
+
+		_i_HashJoinIterator(CI it, KEY_FN key_fn, _i_join_table<K, B> table)
+			: _start(it), _it(it), _key_fn(key_fn), _table(table) {
+			fill();
+		}
+
+		// The matches are compacted without a branch on the outcome of the lookups, which is random,
+		// and the first build row of every match is prefetched.
+		void fill() {
+			static constexpr _i_row_chain none{0, 0};
+			algo::group<K, _i_row_chain> *found[join_batch];
+			_batch_pos  = 0;
+			_batch_size = 0;
+			while (_batch_size == 0 && _it.has_next()) {
+				_i_construct_at(&_start, _it);
+				const auto b = _i_next_batch(_it, _batch, join_batch);
+				_i_lookup_batch(_table._table, _key_fn, b.data, b.size, found);
+				for (uint64 i = 0; i < b.size; i++) {
+					const bool          hit   = found[i] != nullptr;
+					const _i_row_chain *chain = hit ? &found[i]->value : &none;
+					_batch[_batch_size]       = b.data[i];
+					_chains[_batch_size]      = *chain;
+					__builtin_prefetch(_table._rows + chain->first);
+					_batch_size += hit;
+				}
+			}
+			if (_batch_size != 0) { _row = _chains[0].first; }
+		}
+
+		void next_element() {
+			if (++_batch_pos == _batch_size) {
+				fill();
+			} else {
+				_row = _chains[_batch_pos].first;
+			}
+		}
+
+		[[nodiscard]] bool has_next() const { return _batch_pos < _batch_size; }
+
+		value_type operator*() const { return {_table._rows[_row], _batch[_batch_pos]}; }
+
+		void operator++() {
+			if (_row == _chains[_batch_pos].last) {
+				next_element();
+			} else {
+				_row = _table._next[_row];
+			}
+		}
+
+		block<value_type> next_block(value_type *buffer, uint64 n)
+			requires BlockValue<value_type>
+		{
+			uint64 m = 0;
+			for (; m < n && has_next(); m++) {
+				buffer[m] = {_table._rows[_row], _batch[_batch_pos]};
+				++*this;
+			}
+			return {buffer, m};
+		}
+
+		[[nodiscard]] uint64 split_size() const
+			requires SplittableIterator<CI>
+		{
+			return _start.split_size();
+		}
+
+		[[nodiscard]] split_pair<_i_HashJoinIterator> split_at(uint64 k) const
+			requires SplittableIterator<CI>
+		{
+			const split_pair<CI> parts = _start.split_at(k);
+			return {_i_HashJoinIterator(parts.first, _key_fn, _table),
+					_i_HashJoinIterator(parts.second, _key_fn, _table)};
+		}
+	};
+
+	// The probe elements with (semi) or without (anti) a build row of the same key.
+	template<CustomIterator CI, class KEY_FN, TriviallyCopyable K, bool anti>
+		requires BlockValue<typename CI::value_type>
+	struct _i_SemiJoinIterator : cpp_iterator_adapter<_i_SemiJoinIterator<CI, KEY_FN, K, anti>> {
+		using value_type = typename CI::value_type;
+
+		CI                         _start; // the probe side at the start of the batch
+		CI                         _it;
+		KEY_FN                     _key_fn;
+		algo::flat_table<K, uint8> _keys;
+		value_type                 _batch[join_batch]; // the selected elements of the batch
+		uint64                     _batch_size = 0;
+		uint64                     _batch_pos  = 0;
+
+		_i_SemiJoinIterator(CI it, KEY_FN key_fn, algo::flat_table<K, uint8> keys)
+			: _start(it), _it(it), _key_fn(key_fn), _keys(keys) {
+			fill();
+		}
+
+		// Compacts the selected elements of data into out without a branch, out may be data.
+		uint64 select(const value_type *data, uint64 n, value_type *out) const {
+			algo::group<K, uint8> *found[block_size];
+			_i_lookup_batch(_keys, _key_fn, data, n, found);
+			uint64 m = 0;
+			for (uint64 i = 0; i < n; i++) {
+				out[m] = data[i];
+				m += (found[i] != nullptr) != anti;
+			}
+			return m;
+		}
+
+		void fill() {
+			_batch_pos  = 0;
+			_batch_size = 0;
+			while (_batch_size == 0 && _it.has_next()) {
+				_i_construct_at(&_start, _it);
+				const auto b = _i_next_batch(_it, _batch, join_batch);
+				_batch_size  = select(b.data, b.size, _batch);
+			}
+		}
+
+		[[nodiscard]] bool has_next() const { return _batch_pos < _batch_size; }
+
+		value_type operator*() const { return _batch[_batch_pos]; }
+
+		void operator++() {
+			if (++_batch_pos == _batch_size) { fill(); }
+		}
+
+		// After the batch, whole blocks of the probe side are looked up and compacted into buffer.
+		block<value_type> next_block(value_type *buffer, uint64 n) {
+			uint64 m = 0;
+			for (; m < n && _batch_pos < _batch_size; m++) { buffer[m] = _batch[_batch_pos++]; }
+			while (m == 0 && n != 0 && _it.has_next()) {
+				_i_construct_at(&_start, _it);
+				const auto b = _i_next_batch(_it, buffer, min(n, block_size));
+				m            = select(b.data, b.size, buffer);
+			}
+			if (_batch_pos == _batch_size) { fill(); }
+			return {buffer, m};
+		}
+
+		[[nodiscard]] uint64 split_size() const
+			requires SplittableIterator<CI>
+		{
+			return _start.split_size();
+		}
+
+		[[nodiscard]] split_pair<_i_SemiJoinIterator> split_at(uint64 k) const
+			requires SplittableIterator<CI>
+		{
+			const split_pair<CI> parts = _start.split_at(k);
+			return {_i_SemiJoinIterator(parts.first, _key_fn, _keys),
+					_i_SemiJoinIterator(parts.second, _key_fn, _keys)};
+		}
+	};
+
+	template<CustomIterator BI, CustomIterator PI, class BUILD_KEY, class PROBE_KEY>
+	auto hash_join(BI build, PI probe, BUILD_KEY build_key, PROBE_KEY probe_key, arena &a) {
+		using K = algo::group_key_t<BUILD_KEY, typename BI::value_type>;
+		using B = typename BI::value_type;
+		return _i_HashJoinIterator<PI, PROBE_KEY, K, B>(probe, probe_key,
+														_i_join_table<K, B>(build, build_key, a));
+	}
+	template<CustomIterator BI, class BUILD_KEY, class PROBE_KEY>
+	struct hash_join_ {
+		BI        _build;
+		BUILD_KEY _build_key;
+		PROBE_KEY _probe_key;
+		arena    *_arena;
+	};
+	template<CustomIterator BI, class BUILD_KEY, class PROBE_KEY>
+	auto hash_join(BI build, BUILD_KEY build_key, PROBE_KEY probe_key, arena &a) {
+		return hash_join_<BI, BUILD_KEY, PROBE_KEY>{build, build_key, probe_key, &a};
+	}
+	template<CustomIterator PI, CustomIterator BI, class BUILD_KEY, class PROBE_KEY>
+	auto operator|(PI probe, hash_join_<BI, BUILD_KEY, PROBE_KEY> join) {
+		return hash_join(join._build, probe, join._build_key, join._probe_key, *join._arena);
+	}
+
+	template<CustomIterator BI, CustomIterator PI, class BUILD_KEY, class PROBE_KEY>
+	auto semi_join(BI build, PI probe, BUILD_KEY build_key, PROBE_KEY probe_key, arena &a) {
+		using K = algo::group_key_t<BUILD_KEY, typename BI::value_type>;
+		return _i_SemiJoinIterator<PI, PROBE_KEY, K, false>(probe, probe_key,
+															_i_key_set<K>(build, build_key, a));
+	}
+	template<CustomIterator BI, class BUILD_KEY, class PROBE_KEY>
+	struct semi_join_ {
+		BI        _build;
+		BUILD_KEY _build_key;
+		PROBE_KEY _probe_key;
+		arena    *_arena;
+	};
+	template<CustomIterator BI, class BUILD_KEY, class PROBE_KEY>
+	auto semi_join(BI build, BUILD_KEY build_key, PROBE_KEY probe_key, arena &a) {
+		return semi_join_<BI, BUILD_KEY, PROBE_KEY>{build, build_key, probe_key, &a};
+	}
+	template<CustomIterator PI, CustomIterator BI, class BUILD_KEY, class PROBE_KEY>
+	auto operator|(PI probe, semi_join_<BI, BUILD_KEY, PROBE_KEY> join) {
+		return semi_join(join._build, probe, join._build_key, join._probe_key, *join._arena);
+	}
+
+	template<CustomIterator BI, CustomIterator PI, class BUILD_KEY, class PROBE_KEY>
+	auto anti_join(BI build, PI probe, BUILD_KEY build_key, PROBE_KEY probe_key, arena &a) {
+		using K = algo::group_key_t<BUILD_KEY, typename BI::value_type>;
+		return _i_SemiJoinIterator<PI, PROBE_KEY, K, true>(probe, probe_key,
+														   _i_key_set<K>(build, build_key, a));
+	}
+	template<CustomIterator BI, class BUILD_KEY, class PROBE_KEY>
+	struct anti_join_ {
+		BI        _build;
+		BUILD_KEY _build_key;
+		PROBE_KEY _probe_key;
+		arena    *_arena;
+	};
+	template<CustomIterator BI, class BUILD_KEY, class PROBE_KEY>
+	auto anti_join(BI build, BUILD_KEY build_key, PROBE_KEY probe_key, arena &a) {
+		return anti_join_<BI, BUILD_KEY, PROBE_KEY>{build, build_key, probe_key, &a};
+	}
+	template<CustomIterator PI, CustomIterator BI, class BUILD_KEY, class PROBE_KEY>
+	auto operator|(PI probe, anti_join_<BI, BUILD_KEY, PROBE_KEY> join) {
+		return anti_join(join._build, probe, join._build_key, join._probe_key, *join._arena);
+	}
+
+} // namespace it
+
+#endif //D_ITERATOR_JOIN_H
@@ -0,0 +1,126 @@
+//
+// Created by af on 16/10/26.
+//
+
+#ifndef D_ITERATOR_MAPPED_FILE_H
+#define D_ITERATOR_MAPPED_FILE_H
+
+#include "array.h"
+
+#if !defined(NO_STD) && __has_include(<sys/mman.h>)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * A file of fixed size records, mapped read-only into memory.
+ * Mapping doesn't read the file, so opening it takes the same time for any size,
+ * the pages are loaded by the kernel when they are first touched.
+ * to_iterator() returns an array_view over the records, a trailing partial record is ignored.
+ * The mapping is owned by the mapped_file, so it has to outlive the iterators.
+ */
+namespace it {
+
+	enum class AccessPattern {
+		Sequential, // read ahead aggressively and drop pages behind the scan
+		Random,     // no read ahead
+	};
+
+	struct map_options {
+		AccessPattern pattern    = AccessPattern::Sequential;
+		bool          populate   = false; // fault in the whole file while mapping, startup becomes O(size)
+		bool          huge_pages = false; // transparent huge pages, if the kernel supports them for files
+	};
+
+	template<TriviallyCopyable T>
+	struct mapped_file {
+		void  *_mapping = nullptr;
+		uint64 _bytes   = 0;
+		int    _error   = 0;
+
+		// On failure the file is empty and error() returns the errno.
+		explicit mapped_file(const char *path, map_options options = {}) {
+			const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+			if (fd < 0) {
+				_error = errno;
+				return;
+			}
+			struct stat status {};
+			if (::fstat(fd, &status) != 0) {
+				_error = errno;
+			} else if (status.st_size != 0) {
+				int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+				if (options.populate) { flags |= MAP_POPULATE; }
+#endif
+				void *mapping = ::mmap(nullptr, uint64(status.st_size), PROT_READ, flags, fd, 0);
+				if (mapping == MAP_FAILED) {
+					_error = errno;
+				} else {
+					_mapping = mapping;
+					_bytes   = uint64(status.st_size);
+					advise(options);
+				}
+			}
+			::close(fd);
+		}
+
+		mapped_file(const mapped_file &)            = delete;
+		mapped_file &operator=(const mapped_file &) = delete;
+
+		mapped_file(mapped_file &&other) noexcept
+			: _mapping(other._mapping), _bytes(other._bytes), _error(other._error) {
+			other._mapping = nullptr;
+			other._bytes   = 0;
+		}
+
+		mapped_file &operator=(mapped_file &&other) noexcept {
+			if (this != &other) {
+				unmap();
+				_mapping       = other._mapping;
+				_bytes         = other._bytes;
+				_error         = other._error;
+				other._mapping = nullptr;
+				other._bytes   = 0;
+			}
+			return *this;
+		}
+
+		~mapped_file() { unmap(); }
+
+		[[nodiscard]] int error() const { return _error; }
+
+		[[nodiscard]] uint64 count() const { return _bytes / sizeof(T); }
+
+		[[nodiscard]] const T *data() const { return static_cast<const T *>(_mapping); }
+
+		[[nodiscard]] array_view<T> to_iterator() const { return {data(), count()}; }
+
+		// The advice is only a hint, failures are ignored.
+		void advise(map_options options) const {
+			if (_mapping == nullptr) { return; }
+			if (options.pattern == AccessPattern::Sequential) {
+				::madvise(_mapping, _bytes, MADV_SEQUENTIAL);
+				::madvise(_mapping, _bytes, MADV_WILLNEED);
+			} else {
+				::madvise(_mapping, _bytes, MADV_RANDOM);
+			}
+#if defined(MADV_HUGEPAGE)
+			if (options.huge_pages) { ::madvise(_mapping, _bytes, MADV_HUGEPAGE); }
+#endif
+		}
+
+		void unmap() {
+			if (_mapping != nullptr) { ::munmap(_mapping, _bytes); }
+			_mapping = nullptr;
+			_bytes   = 0;
+		}
+	};
+
+} // namespace it
+
+#endif
+
+#endif //D_ITERATOR_MAPPED_FILE_H
@@ -0,0 +1,323 @@
+//
+// Created by af on 16/10/26.
+//
+
+#ifndef D_ITERATOR_MERGE_H
+#define D_ITERATOR_MERGE_H
+
+#include "arena.h"
+#include "array.h"
+
+/*
+ * Lazy merges of iterators that are already sorted, so sorted shards are never materialized and sorted again.
+ *
+ * merge(it_1, it_2, cmp) is stable, of equal elements the ones of it_1 come first.
+ * If both inputs are contiguous, blocks are merged without a branch: every step compares the two heads,
+ * stores the smaller one with a conditional move and advances one side by the result of the comparison.
+ *
+ * merge_k(it_1, ..., it_k) builds a balanced tree of two-way merges at compile time.
+ * merge_k(iterators, arena, cmp) merges a runtime number of iterators with a loser tree in the arena:
+ * node n holds the loser of the match below it and node 0 the overall winner, so after the winner advances
+ * only the log2(k) matches on the path from its leaf to the root are replayed.
+ *
+ * merge_join(it_1, it_2, key_1, key_2) pairs the elements with equal keys of two inputs sorted by key,
+ * without allocating. A run of equal keys of it_2 is replayed from a copy for each element of it_1 with that key.
+ */
+namespace it {
+
+	template<CustomIterator CI_1, CustomIterator CI_2, class CMP = _i_less>
+	constexpr auto merge(CI_1 it_1, CI_2 it_2, CMP cmp = {}) {
+		using T_1 = CI_1::value_type;
+		using T_2 = CI_2::value_type;
+		static_assert(is_same_v<T_1, T_2>);
+
+		struct _ : cpp_iterator_adapter<_> {
+			using value_type [[maybe_unused]] = TypeMapper<T_1>::Type;
+			static constexpr bool costly_count() { return CostlyCount<CI_1> || CostlyCount<CI_2>; }
+
+			CI_1 _it_1;
+			CI_2 _it_2;
+			CMP  _cmp;
+			bool _second = false; /* the next element is taken from _it_2 */
+
+			constexpr _(CI_1 it_1, CI_2 it_2, CMP cmp) : _it_1(it_1), _it_2(it_2), _cmp(cmp) { select(); }
+
+			constexpr void select() {
+				_second = _it_2.has_next() && (!_it_1.has_next() || _cmp(*_it_2, *_it_1));
+			}
+
+			constexpr void operator++() {
+				if (_second) {
+					++_it_2;
+				} else {
+					++_it_1;
+				}
+				select();
+			}
+
+			constexpr value_type operator*() const {
+				if (_second) { return *_it_2; }
+				return *_it_1;
+			}
+
+			[[nodiscard]] constexpr bool has_next() const { return _it_1.has_next() || _it_2.has_next(); }
+
+			[[nodiscard]] constexpr uint64 count() const
+				requires CountingIterator<CI_1> && CountingIterator<CI_2>
+			{
+				if constexpr (CountingIterator<CI_1> && CountingIterator<CI_2>) {
+					return _it_1.count() + _it_2.count();
+				}
+				return 0;
+			}
+
+			constexpr block<remove_reference_t<value_type>>
+			next_block(add_pointer_to_removed_reference_t<value_type> buffer, uint64 n)
+				requires ContiguousIterator<CI_1> && ContiguousIterator<CI_2> && RandomAccessIterator<CI_1>
+						 && RandomAccessIterator<CI_2> && BlockValue<value_type>
+			{
+				if constexpr (ContiguousIterator<CI_1> && ContiguousIterator<CI_2>) {
+					const auto  *a      = _it_1.data();
+					const auto  *b      = _it_2.data();
+					const uint64 size_a = _it_1.count();
+					const uint64 size_b = _it_2.count();
+					uint64       i      = 0;
+					uint64       j      = 0;
+					uint64       m      = 0;
+
+					// Every step takes one element, so this many steps can't run past the end of either side.
+					for (uint64 steps = min(n, min(size_a, size_b)); steps != 0;
+						 steps        = min(n - m, min(size_a - i, size_b - j))) {
+						for (uint64 s = 0; s < steps; s++) {
+							const bool second = _cmp(b[j], a[i]);
+							buffer[m++]       = second ? b[j] : a[i];
+							j += second;
+							i += !second;
+						}
+					}
+
+					// One side is exhausted, the rest of the other one is copied.
+					// An empty side may have no data at all, and memcpy from nullptr is undefined even for 0 bytes.
+					const uint64 rest = min(n - m, i == size_a ? size_b - j : size_a - i);
+					if (rest != 0 && i == size_a) {
+						__builtin_memcpy(buffer + m, b + j, rest * sizeof(*a));
+						j += rest;
+					} else if (rest != 0) {
+						__builtin_memcpy(buffer + m, a + i, rest * sizeof(*a));
+						i += rest;
+					}
+					_it_1 += i;
+					_it_2 += j;
+					select();
+					return {buffer, m + rest};
+				}
+				return {};
+			}
+		};
+
+		return _(it_1, it_2, cmp);
+	}
+
+	template<CopyableIterator CI_2, class CMP>
+	struct merge_ {
+		CI_2 _it_2;
+		CMP  _cmp;
+	};
+	template<CopyableIterator CI_2, class CMP = _i_less>
+		requires(!CustomIterator<CMP>)
+	constexpr auto merge(CI_2 it_2, CMP cmp = {}) {
+		return merge_<CI_2, CMP>{it_2, cmp};
+	}
+	template<CustomIterator CI_1, CopyableIterator CI_2, class CMP>
+	constexpr auto operator|(CI_1 it_1, merge_<CI_2, CMP> merge_2) {
+		return merge(it_1, merge_2._it_2, merge_2._cmp);
+	}
+
+	// Merges the first two iterators and queues the result behind the others, so the tree is balanced.
+	template<class CMP, CustomIterator CI>
+	constexpr auto _i_merge_pairs(CMP, CI it) {
+		return it;
+	}
+	template<class CMP, CustomIterator CI_1, CustomIterator CI_2, CustomIterator... CIS>
+	constexpr auto _i_merge_pairs(CMP cmp, CI_1 it_1, CI_2 it_2, CIS... its) {
+		return _i_merge_pairs(cmp, its..., merge(it_1, it_2, cmp));
+	}
+
+	// Which of equal elements of different iterators comes first is unspecified.
+	template<class CMP, CustomIterator CI, CustomIterator... CIS>
+		requires(!CustomIterator<CMP>)
+	constexpr auto merge_k(CMP cmp, CI it, CIS... its) {
+		return _i_merge_pairs(cmp, it, its...);
+	}
+	template<CustomIterator CI, CustomIterator... CIS>
+	constexpr auto merge_k(CI it, CIS... its) {
+		return _i_merge_pairs(_i_less{}, it, its...);
+	}
+
+	/*
+	 * The leaves and the tree live in the arena, so copies of the iterator share the position.
+	 * Leaf i is node k + i, the children of node n are 2n and 2n + 1.
+	 * Each leaf keeps the head of its iterator, so a match compares two values next to each other
+	 * and is computed without a branch.
+	 */
+	template<CustomIterator CI, class CMP>
+	struct _i_MergeKIterator : cpp_iterator_adapter<_i_MergeKIterator<CI, CMP>> {
+		using value_type [[maybe_unused]] = CI::value_type;
+		static constexpr bool costly_count() { return CostlyCount<CI>; }
+
+		struct leaf {
+			CI         it;
+			value_type head;
+			bool       live;
+		};
+
+		leaf   *_leaves = nullptr;
+		uint32 *_losers = nullptr;
+		uint32  _k      = 0;
+		CMP     _cmp;
+
+		constexpr _i_MergeKIterator(leaf *leaves, uint32 *losers, uint32 k, CMP cmp)
+			: _leaves(leaves), _losers(losers), _k(k), _cmp(cmp) {
+			if (_k != 0) { _losers[0] = build(1); }
+		}
+
+		// Exhausted leaves lose every match, ties go to the lower index, so the merge is stable.
+		[[nodiscard]] constexpr bool beats(uint32 a, uint32 b) const {
+			const leaf &x = _leaves[a];
+			const leaf &y = _leaves[b];
+			const uint32 before = uint32(_cmp(x.head, y.head)) | (uint32(!_cmp(y.head, x.head)) & uint32(a < b));
+			return (uint32(x.live) & (uint32(!y.live) | before)) != 0;
+		}
+
+		// Plays the matches below node n and returns the winner.
+		constexpr uint32 build(uint32 n) {
+			if (n >= _k) { return n - _k; }
+			const uint32 a = build(2 * n);
+			const uint32 b = build(2 * n + 1);
+			const bool   w = beats(a, b);
+			_losers[n]     = w ? b : a;
+			return w ? a : b;
+		}
+
+		constexpr void operator++() {
+			uint32 winner = _losers[0];
+			leaf  &l      = _leaves[winner];
+			++l.it;
+			l.live = l.it.has_next();
+			if (l.live) { l.head = *l.it; }
+			for (uint32 n = (_k + winner) / 2; n != 0; n /= 2) {
+				// Swapped with a mask, a branch would be mispredicted half of the time.
+				const uint32 loser = _losers[n];
+				const uint32 swap  = (loser ^ winner) & -uint32(beats(loser, winner));
+				_losers[n]         = loser ^ swap;
+				winner ^= swap;
+			}
+			_losers[0] = winner;
+		}
+
+		constexpr value_type operator*() const { return _leaves[_losers[0]].head; }
+
+		[[nodiscard]] constexpr bool has_next() const { return _k != 0 && _leaves[_losers[0]].live; }
+
+		[[nodiscard]] constexpr uint64 count() const
+			requires CountingIterator<CI>
+		{
+			uint64 result = 0;
+			for (uint32 i = 0; i < _k; i++) { result += _leaves[i].it.count(); }
+			return result;
+		}
+	};
+
+	// If the arena runs out of memory, the result is empty and a.failed() is set.
+	template<CopyableIterator CI, class CMP = _i_less>
+		requires BlockValue<typename CI::value_type>
+	_i_MergeKIterator<CI, CMP> merge_k(array_view<CI> iterators, arena &a, CMP cmp = {}) {
+		using leaf        = _i_MergeKIterator<CI, CMP>::leaf;
+		const auto k      = uint32(iterators.count());
+		leaf      *leaves = a.allocate<leaf>(k);
+		uint32    *losers = a.allocate<uint32>(k);
+		if (k == 0 || leaves == nullptr || losers == nullptr) { return {nullptr, nullptr, 0, cmp}; }
+		for (uint32 i = 0; i < k; i++) {
+			const CI   it   = iterators[i];
+			const bool live = it.has_next();
+			_i_construct_at(leaves + i, leaf{it, live ? *it : typename CI::value_type(), live});
+		}
+		return {leaves, losers, k, cmp};
+	}
+
+	template<CopyableIterator CI_1, CopyableIterator CI_2, class KEY_1, class KEY_2>
+	constexpr auto merge_join(CI_1 it_1, CI_2 it_2, KEY_1 key_1, KEY_2 key_2) {
+		using T_1 = CI_1::value_type;
+		using T_2 = CI_2::value_type;
+		struct pair_t {
+			TypeMapper<T_1>::Type first;
+			TypeMapper<T_2>::Type second;
+		};
+
+		struct _ : cpp_iterator_adapter<_> {
+			using value_type [[maybe_unused]] = pair_t;
+
+			CI_1  _it_1;
+			CI_2  _it_2;
+			CI_2  _run; /* the first element of it_2 with the current key */
+			KEY_1 _key_1;
+			KEY_2 _key_2;
+
+			constexpr _(CI_1 it_1, CI_2 it_2, KEY_1 key_1, KEY_2 key_2)
+				: _it_1(it_1), _it_2(it_2), _run(it_2), _key_1(key_1), _key_2(key_2) {
+				seek();
+			}
+
+			// Advances the smaller side until the keys are equal.
+			constexpr void seek() {
+				while (_it_1.has_next() && _it_2.has_next()) {
+					const auto k_1 = _key_1(*_it_1);
+					const auto k_2 = _key_2(*_it_2);
+					if (k_1 < k_2) {
+						++_it_1;
+					} else if (k_2 < k_1) {
+						++_it_2;
+					} else {
+						_i_construct_at(&_run, _it_2);
+						return;
+					}
+				}
+			}
+
+			constexpr void operator++() {
+				++_it_2;
+				if (_it_2.has_next() && _key_2(*_it_2) == _key_1(*_it_1)) { return; }
+				++_it_1;
+				if (_it_1.has_next() && _key_1(*_it_1) == _key_2(*_run)) {
+					_i_construct_at(&_it_2, _run);
+					return;
+				}
+				seek();
+			}
+
+			constexpr pair_t operator*() const { return {*_it_1, *_it_2}; }
+
+			[[nodiscard]] constexpr bool has_next() const { return _it_1.has_next() && _it_2.has_next(); }
+		};
+
+		return _(it_1, it_2, key_1, key_2);
+	}
+
+	template<CopyableIterator CI_2, class KEY_1, class KEY_2>
+	struct merge_join_ {
+		CI_2  _it_2;
+		KEY_1 _key_1;
+		KEY_2 _key_2;
+	};
+	template<CopyableIterator CI_2, class KEY_1, class KEY_2>
+	constexpr auto merge_join(CI_2 it_2, KEY_1 key_1, KEY_2 key_2) {
+		return merge_join_<CI_2, KEY_1, KEY_2>{it_2, key_1, key_2};
+	}
+	template<CopyableIterator CI_1, CopyableIterator CI_2, class KEY_1, class KEY_2>
+	constexpr auto operator|(CI_1 it_1, merge_join_<CI_2, KEY_1, KEY_2> join) {
+		return merge_join(it_1, join._it_2, join._key_1, join._key_2);
+	}
+
+} // namespace it
+
+#endif //D_ITERATOR_MERGE_H
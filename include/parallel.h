@@ -0,0 +1,399 @@
+//
+// Created by af on 16/10/26.
+//
+
+#ifndef D_ITERATOR_PARALLEL_H
+#define D_ITERATOR_PARALLEL_H
+
+#include "group_by.h"
+#include "iterator.h"
+#include "top_k.h"
+
+#if !defined(NO_STD)
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <vector>
+
+/*
+ * Multi-threaded algorithms over splittable iterators.
+ * The source is cut into chunks with split_at, every worker runs the same pipeline type on its chunks
+ * and the per worker results are combined at the end.
+ * Lambdas in the pipeline are called concurrently, so they have to be pure.
+ *
+ * Scheduling is work stealing: every worker owns a contiguous range of chunks and takes them from the front.
+ * A worker that runs out steals the back half of another worker's range,
+ * so a skewed filter doesn't leave the other threads idle.
+ * Every chunk keeps its own result and the results are combined in chunk order on the calling thread,
+ * so the combiner only has to be associative, and the initial value has to be its identity.
+ */
+namespace algo {
+
+	inline constexpr uint64 chunks_per_thread = 16;
+
+	inline uint64 default_threads() {
+		const uint64 threads = std::thread::hardware_concurrency();
+		return threads == 0 ? 1 : threads;
+	}
+
+	// begin << 32 | end, both owner and thieves only ever shrink it with a CAS.
+	struct alignas(64) _i_chunk_range {
+		std::atomic<uint64> range{0};
+	};
+
+	// Padded, so the workers don't share cache lines, and no vector<bool> packing for bool results.
+	template<typename OUT>
+	struct alignas(64) _i_worker_result {
+		OUT value;
+	};
+
+	inline constexpr uint64 _i_range(uint64 begin, uint64 end) { return begin << 32 | end; }
+
+	inline bool _i_pop_front(_i_chunk_range &own, uint64 &chunk) {
+		uint64 range = own.range.load(std::memory_order_acquire);
+		while (true) {
+			const uint64 begin = range >> 32;
+			const uint64 end   = range & 0xFFFFFFFF;
+			if (begin >= end) { return false; }
+			if (own.range.compare_exchange_weak(range, _i_range(begin + 1, end),
+												std::memory_order_acq_rel)) {
+				chunk = begin;
+				return true;
+			}
+		}
+	}
+
+	inline bool _i_steal_back(_i_chunk_range &victim, _i_chunk_range &own) {
+		uint64 range = victim.range.load(std::memory_order_acquire);
+		while (true) {
+			const uint64 begin = range >> 32;
+			const uint64 end   = range & 0xFFFFFFFF;
+			if (begin >= end) { return false; }
+			const uint64 stolen = (end - begin + 1) / 2;
+			if (victim.range.compare_exchange_weak(range, _i_range(begin, end - stolen),
+												   std::memory_order_acq_rel)) {
+				own.range.store(_i_range(end - stolen, end), std::memory_order_release);
+				return true;
+			}
+		}
+	}
+
+	template<it::SplittableIterator CI>
+	void _i_split_chunks(const CI &it, uint64 pieces, std::vector<CI> &chunks) {
+		if (pieces == 1) {
+			chunks.push_back(it);
+			return;
+		}
+		const uint64 size = it.split_size();
+		const uint64 left = pieces / 2;
+		const auto   parts
+				= it.split_at(size / pieces * left + size % pieces * left / pieces);
+		_i_split_chunks(parts.first, left, chunks);
+		_i_split_chunks(parts.second, pieces - left, chunks);
+	}
+
+	template<it::SplittableIterator CI>
+	uint64 _i_worker_count(const CI &it, uint64 threads) {
+		return it::min(it::min(threads, it.split_size()), uint64(0xFFFF));
+	}
+
+	// Runs body(worker, chunk) for the chunk indices 0 to pieces on threads workers, worker 0 is the calling thread.
+	template<class BODY>
+	void _i_run_chunks(uint64 pieces, uint64 threads, BODY body) {
+		std::vector<_i_chunk_range> ranges(threads);
+		for (uint64 t = 0; t < threads; t++) {
+			ranges[t].range.store(_i_range(t * pieces / threads, (t + 1) * pieces / threads),
+								  std::memory_order_relaxed);
+		}
+
+		auto worker = [&](uint64 self) {
+			uint64 chunk;
+			while (true) {
+				while (_i_pop_front(ranges[self], chunk)) { body(self, chunk); }
+				bool stolen = false;
+				for (uint64 i = 1; i < threads && !stolen; i++) {
+					stolen = _i_steal_back(ranges[(self + i) % threads], ranges[self]);
+				}
+				if (!stolen) { break; }
+			}
+		};
+
+		std::vector<std::thread> workers;
+		workers.reserve(threads - 1);
+		for (uint64 t = 1; t < threads; t++) { workers.emplace_back(worker, t); }
+		worker(0);
+		for (auto &w: workers) { w.join(); }
+	}
+
+	// The chunks of the iterator for threads workers, in source order.
+	template<it::SplittableIterator CI>
+	std::vector<CI> _i_chunks(const CI &it, uint64 threads) {
+		const uint64    pieces = it::min(threads * chunks_per_thread, it.split_size());
+		std::vector<CI> chunks;
+		chunks.reserve(pieces);
+		_i_split_chunks(it, pieces, chunks);
+		return chunks;
+	}
+
+	// Runs body(worker, chunk) for every chunk of the iterator.
+	template<it::SplittableIterator CI, class BODY>
+	void _i_for_each_chunk(const CI &it, uint64 threads, BODY body) {
+		const std::vector<CI> chunks = _i_chunks(it, threads);
+		_i_run_chunks(chunks.size(), threads,
+					  [&](uint64 self, uint64 chunk) { body(self, chunks[chunk]); });
+	}
+
+	template<it::SplittableIterator CI, class OUT, class CHUNK_FN, class COMBINE>
+	OUT _i_parallel_chunks(const CI &it, OUT identity, CHUNK_FN chunk_fn, COMBINE combine,
+						   uint64 threads) {
+		threads = _i_worker_count(it, threads);
+		if (threads <= 1) { return combine(identity, chunk_fn(it)); }
+
+		const std::vector<CI>              chunks = _i_chunks(it, threads);
+		std::vector<_i_worker_result<OUT>> results(chunks.size(), {identity});
+		_i_run_chunks(chunks.size(), threads,
+					  [&](uint64, uint64 chunk) { results[chunk].value = chunk_fn(chunks[chunk]); });
+
+		OUT acc = identity;
+		for (const auto &result: results) { acc = combine(acc, result.value); }
+		return acc;
+	}
+
+	/*
+	 * Every chunk is folded with func starting from initial, the chunk results are folded with combine.
+	 * initial has to be the identity of combine.
+	 */
+	template<it::SplittableIterator CI, class OUT, FoldFunction_I<OUT> L, class C>
+	OUT parallel_reduce(CI it, L func, OUT initial, C combine, uint64 threads = default_threads()) {
+		return _i_parallel_chunks(
+				it, initial, [&](CI chunk) { return reduce(chunk, func, initial); }, combine, threads);
+	}
+	template<typename OUT, FoldFunction_I<OUT> L, class C>
+	struct parallel_reduce_ {
+		const OUT    _initial;
+		const L      _func;
+		const C      _combine;
+		const uint64 _threads;
+	};
+	template<typename OUT, FoldFunction_I<OUT> L, class C>
+	auto parallel_reduce(OUT initial, L func, C combine, uint64 threads = default_threads()) {
+		return parallel_reduce_<OUT, L, C>{
+				._initial = initial,
+				._func    = func,
+				._combine = combine,
+				._threads = threads,
+		};
+	}
+	template<it::SplittableIterator CI, class OUT, FoldFunction_I<OUT> L, class C>
+	auto operator|(CI it, parallel_reduce_<OUT, L, C> reduce) {
+		return parallel_reduce(it, reduce._func, reduce._initial, reduce._combine, reduce._threads);
+	}
+
+	template<typename OUT, it::SplittableIterator CI>
+	OUT parallel_sum(CI it, uint64 threads = default_threads()) {
+		return _i_parallel_chunks(
+				it, OUT(0), [](CI chunk) { return sum<OUT>(chunk); },
+				[](OUT a, OUT b) { return a + b; }, threads);
+	}
+	template<it::SplittableIterator CI>
+	auto parallel_sum(CI it, uint64 threads = default_threads()) {
+		using E = typename CI::value_type;
+		return parallel_sum<E>(it, threads);
+	}
+	template<typename OUT>
+	struct parallel_sum_ {
+		uint64 _threads;
+	};
+	template<typename OUT>
+	auto parallel_sum(uint64 threads = default_threads()) {
+		return parallel_sum_<OUT>{threads};
+	}
+	template<it::SplittableIterator CI, typename OUT>
+	auto operator|(CI it, parallel_sum_<OUT> sum) {
+		return parallel_sum<OUT>(it, sum._threads);
+	}
+
+	template<it::SplittableIterator CI>
+	uint64 parallel_count(CI it, uint64 threads = default_threads()) {
+		return _i_parallel_chunks(
+				it, uint64(0), [](CI chunk) { return count(chunk); },
+				[](uint64 a, uint64 b) { return a + b; }, threads);
+	}
+	struct parallel_count_ {
+		uint64 _threads;
+	};
+	inline auto parallel_count(uint64 threads = default_threads()) { return parallel_count_{threads}; }
+	template<it::SplittableIterator CI>
+	auto operator|(CI it, parallel_count_ count) {
+		return parallel_count(it, count._threads);
+	}
+
+	// Every chunk keeps its own heap, the sorted per chunk results are merged.
+	template<uint64 K, it::SplittableIterator CI, class CMP = _i_less>
+	auto parallel_top_k(CI it, CMP cmp = {}, uint64 threads = default_threads()) {
+		using R = decltype(top_k<K>(it, cmp));
+		return _i_parallel_chunks(
+				it, R(), [&cmp](CI chunk) { return top_k<K>(chunk, cmp); },
+				[&cmp](const R &a, const R &b) { return merge_top_k(a, b, cmp); }, threads);
+	}
+	template<uint64 K, class CMP>
+	struct parallel_top_k_ {
+		CMP    _cmp;
+		uint64 _threads;
+	};
+	template<uint64 K, class CMP = _i_less>
+		requires(!it::CustomIterator<CMP>)
+	auto parallel_top_k(CMP cmp = {}, uint64 threads = default_threads()) {
+		return parallel_top_k_<K, CMP>{cmp, threads};
+	}
+	template<it::SplittableIterator CI, uint64 K, class CMP>
+	auto operator|(CI it, parallel_top_k_<K, CMP> top) {
+		return parallel_top_k<K>(it, top._cmp, top._threads);
+	}
+
+	/*
+	 * Every worker aggregates its chunks into its own table in its own arena, so the workers share nothing.
+	 * The worker arenas grow with the functions of a, or from malloc if a has none.
+	 * The worker tables are merged into the result with the combine of the aggregate,
+	 * the order of the groups depends on the scheduling.
+	 * If a worker or the result runs out of memory, the groups are incomplete and a.failed() is set.
+	 */
+	template<it::SplittableIterator CI, class KEY_FN, typename A, class FOLD, class COMBINE>
+	auto parallel_group_by(CI it, KEY_FN key_fn, aggregator<A, FOLD, COMBINE> agg, arena &a,
+						   uint64 threads = default_threads()) {
+		static_assert(!it::is_same_v<COMBINE, no_combine>, "parallel_group_by needs an aggregate with a combine");
+		using table_t = flat_table<group_key_t<KEY_FN, typename CI::value_type>, A>;
+		threads       = _i_worker_count(it, threads);
+		if (threads <= 1) { return group_by(it, key_fn, agg, a); }
+
+		struct alignas(64) local {
+			arena   memory;
+			table_t table;
+			bool    failed;
+			local(arena::grow_fn grow, arena::release_fn release)
+				: memory(grow, release), table(memory), failed(memory.failed()) {}
+		};
+		// A deque, because the arenas can't move.
+		std::deque<local> locals;
+		for (uint64 t = 0; t < threads; t++) {
+			if (a._grow == nullptr) {
+				locals.emplace_back(arena::default_grow, arena::default_release);
+			} else {
+				locals.emplace_back(a._grow, a._release);
+			}
+		}
+		_i_for_each_chunk(it, threads, [&](uint64 self, const CI &chunk) {
+			local &l = locals[self];
+			if (!l.failed) { l.failed = !_i_group_into(chunk, key_fn, agg, l.table); }
+		});
+
+		uint64 expected = 0;
+		for (const auto &l: locals) { expected = it::max(expected, l.table.count()); }
+		table_t result(a, expected);
+		for (const auto &l: locals) {
+			if (l.failed) { a._failed = true; }
+			if (!result.merge(l.table, agg.combine)) { break; }
+		}
+		return result.to_iterator();
+	}
+	template<class KEY_FN, typename A, class FOLD, class COMBINE>
+	struct parallel_group_by_ {
+		KEY_FN                       _key_fn;
+		aggregator<A, FOLD, COMBINE> _agg;
+		arena                       *_arena;
+		uint64                       _threads;
+	};
+	template<class KEY_FN, typename A, class FOLD, class COMBINE>
+	auto parallel_group_by(KEY_FN key_fn, aggregator<A, FOLD, COMBINE> agg, arena &a,
+						   uint64 threads = default_threads()) {
+		return parallel_group_by_<KEY_FN, A, FOLD, COMBINE>{key_fn, agg, &a, threads};
+	}
+	template<it::SplittableIterator CI, class KEY_FN, typename A, class FOLD, class COMBINE>
+	auto operator|(CI it, parallel_group_by_<KEY_FN, A, FOLD, COMBINE> group) {
+		return parallel_group_by(it, group._key_fn, group._agg, *group._arena, group._threads);
+	}
+
+	template<typename OUT, it::CustomIterator CI, class OP>
+	OUT _i_reduce_chunk(CI chunk, OP op) {
+		if constexpr (it::is_same_v<OP, it::_i_plus> && simd::Arithmetic<OUT>) { return sum<OUT>(chunk); }
+		OUT acc = OUT(*chunk);
+		++chunk;
+		while (chunk.has_next()) {
+			acc = op(acc, *chunk);
+			++chunk;
+		}
+		return acc;
+	}
+
+	/*
+	 * Two passes over the same chunks: every chunk is reduced, the chunk sums are scanned into the initial value
+	 * of every chunk on the calling thread, then every chunk is scanned into its part of out.
+	 * The chunks start in out at the counts of the chunks before them, so the iterator has to count its elements.
+	 * The chunk order is kept, so op only has to be associative.
+	 */
+	template<bool inclusive, it::SplittableIterator CI, typename OUT, class OP>
+		requires it::CountingIterator<CI>
+	scan_result<OUT> _i_parallel_scan_into(CI it, OUT *out, OUT init, OP op, uint64 threads) {
+		threads = _i_worker_count(it, threads);
+		if (threads <= 1) { return _i_scan_into<inclusive>(it, out, init, op); }
+
+		const std::vector<CI> chunks = _i_chunks(it, threads);
+		const uint64          pieces = chunks.size();
+
+		std::vector<OUT> carries(pieces + 1, init);
+		_i_run_chunks(pieces, threads, [&](uint64, uint64 chunk) {
+			carries[chunk + 1] = _i_reduce_chunk<OUT>(chunks[chunk], op);
+		});
+		std::vector<uint64> offsets(pieces + 1, 0);
+		for (uint64 c = 0; c < pieces; c++) {
+			carries[c + 1] = op(carries[c], carries[c + 1]);
+			offsets[c + 1] = offsets[c] + chunks[c].count();
+		}
+		_i_run_chunks(pieces, threads, [&](uint64, uint64 chunk) {
+			_i_scan_into<inclusive>(chunks[chunk], out + offsets[chunk], carries[chunk], op);
+		});
+		return {offsets[pieces], carries[pieces]};
+	}
+	template<it::SplittableIterator CI, typename OUT, class OP = it::_i_plus>
+		requires it::CountingIterator<CI>
+	scan_result<OUT> parallel_inclusive_scan_into(CI it, OUT *out, OUT init = OUT(), OP op = {},
+												  uint64 threads = default_threads()) {
+		return _i_parallel_scan_into<true>(it, out, init, op, threads);
+	}
+	template<it::SplittableIterator CI, typename OUT, class OP = it::_i_plus>
+		requires it::CountingIterator<CI>
+	scan_result<OUT> parallel_exclusive_scan_into(CI it, OUT *out, OUT init = OUT(), OP op = {},
+												  uint64 threads = default_threads()) {
+		return _i_parallel_scan_into<false>(it, out, init, op, threads);
+	}
+
+	// Once an element is found, the remaining chunks are skipped.
+	template<it::SplittableIterator CI>
+	bool parallel_any(CI it, uint64 threads = default_threads())
+		requires it::is_same_v<typename CI::value_type, bool>
+	{
+		std::atomic<bool> found{false};
+		return _i_parallel_chunks(
+				it, false,
+				[&found](CI chunk) {
+					if (found.load(std::memory_order_relaxed)) { return true; }
+					const bool result = any(chunk);
+					if (result) { found.store(true, std::memory_order_relaxed); }
+					return result;
+				},
+				[](bool a, bool b) { return a || b; }, threads);
+	}
+	struct parallel_any_ {
+		uint64 _threads;
+	};
+	inline auto parallel_any(uint64 threads = default_threads()) { return parallel_any_{threads}; }
+	template<it::SplittableIterator CI>
+	auto operator|(CI it, parallel_any_ any) {
+		return parallel_any(it, any._threads);
+	}
+
+} // namespace algo
+
+#endif
+
+#endif //D_ITERATOR_PARALLEL_H
@@ -0,0 +1,615 @@
+//
+// Created by af on 16/10/26.
+//
+
+#ifndef D_ITERATOR_SIMD_H
+#define D_ITERATOR_SIMD_H
+
+#include "c_int_types.h"
+
+/*
+ * Explicitly vectorized kernels over contiguous memory.
+ * They are written with the GCC / Clang vector extensions, so they work with NO_STD and don't need -ffast-math.
+ * Other compilers and constant evaluation use the scalar loop, which computes the same result.
+ *
+ * Every kernel runs several independent accumulators, so the loop isn't bound by the latency of a single add.
+ */
+namespace simd {
+
+	template<typename T>
+	struct is_integer {
+		static constexpr bool value = false;
+	};
+	template<typename T>
+	struct is_float {
+		static constexpr bool value = false;
+	};
+
+	// clang-format off
+	template<> struct is_integer<char> { static constexpr bool value = true; };
+	template<> struct is_integer<signed char> { static constexpr bool value = true; };
+	template<> struct is_integer<unsigned char> { static constexpr bool value = true; };
+	template<> struct is_integer<short> { static constexpr bool value = true; };
+	template<> struct is_integer<unsigned short> { static constexpr bool value = true; };
+	template<> struct is_integer<int> { static constexpr bool value = true; };
+	template<> struct is_integer<unsigned int> { static constexpr bool value = true; };
+	template<> struct is_integer<long> { static constexpr bool value = true; };
+	template<> struct is_integer<unsigned long> { static constexpr bool value = true; };
+	template<> struct is_integer<long long> { static constexpr bool value = true; };
+	template<> struct is_integer<unsigned long long> { static constexpr bool value = true; };
+	template<> struct is_float<float> { static constexpr bool value = true; };
+	template<> struct is_float<double> { static constexpr bool value = true; };
+	// clang-format on
+
+	template<typename T>
+	concept Integer = is_integer<T>::value;
+
+	template<typename T>
+	concept Float = is_float<T>::value;
+
+	template<typename T>
+	concept Arithmetic = Integer<T> || Float<T>;
+
+	// Integer sums are accumulated in the unsigned type of the same width, so overflow wraps instead of being UB.
+	template<uint64 bytes>
+	struct unsigned_of;
+	// clang-format off
+	template<> struct unsigned_of<1> { using type = uint8; };
+	template<> struct unsigned_of<2> { using type = uint16; };
+	template<> struct unsigned_of<4> { using type = uint32; };
+	template<> struct unsigned_of<8> { using type = uint64; };
+	// clang-format on
+	template<Integer T>
+	using unsigned_t = typename unsigned_of<sizeof(T)>::type;
+
+	// The scalar and the vector code must agree on ties, so both use these.
+	template<typename T>
+	constexpr T min_op(T a, T b) {
+		return b < a ? b : a;
+	}
+
+	template<typename T>
+	constexpr T max_op(T a, T b) {
+		return a < b ? b : a;
+	}
+
+	// Number of accumulators, each one a full vector.
+	inline constexpr uint64 accumulators = 4;
+
+	// Floats are summed pairwise, with blocks of this size summed directly.
+	inline constexpr uint64 pairwise_block = 128;
+
+#if defined(__GNUC__)
+	// 32 bytes are one AVX register, on SSE and NEON the compiler uses two.
+	inline constexpr uint64 vector_bytes = 32;
+
+	template<typename T, uint64 lanes>
+	struct vector_s {
+		typedef T type __attribute__((vector_size(sizeof(T) * lanes)));
+	};
+
+	template<typename T, uint64 lanes = vector_bytes / sizeof(T)>
+	using vector = typename vector_s<T, lanes>::type;
+
+	// Unaligned load. Vectors are passed by reference, since returning them
+	// by value would change the ABI depending on the enabled instruction sets.
+	template<typename V, typename T>
+	inline void load(V &v, const T *data) {
+		__builtin_memcpy(&v, data, sizeof(V));
+	}
+#endif
+
+	template<typename ACC, Arithmetic T>
+		requires Integer<ACC>
+	constexpr ACC sum_integer(const T *data, uint64 n) {
+		using U       = unsigned_t<ACC>;
+		uint64 i      = 0;
+		U      result = 0;
+#if defined(__GNUC__)
+		if (!__builtin_is_constant_evaluated()) {
+			constexpr uint64 lanes = vector_bytes / sizeof(ACC);
+			using VA               = vector<ACC, lanes>;
+			using VU               = vector<U, lanes>;
+			using VT               = vector<T, lanes>;
+
+			VU acc[accumulators] = {};
+			for (; i + accumulators * lanes <= n; i += accumulators * lanes) {
+				for (uint64 k = 0; k < accumulators; k++) {
+					VT v;
+					load(v, data + i + k * lanes);
+					acc[k] += __builtin_convertvector(__builtin_convertvector(v, VA), VU);
+				}
+			}
+			for (uint64 k = 1; k < accumulators; k++) { acc[0] += acc[k]; }
+			for (uint64 j = 0; j < lanes; j++) { result += acc[0][j]; }
+		}
+#endif
+		for (; i < n; i++) { result += U(ACC(data[i])); }
+		return ACC(result);
+	}
+
+	/*
+	 * The summation order only depends on n, never on the compiler flags or the target.
+	 * The rounding error grows with O(log n) instead of O(n).
+	 */
+	template<typename ACC, Arithmetic T>
+		requires Float<ACC>
+	constexpr ACC sum_pairwise(const T *data, uint64 n) {
+		if (n > pairwise_block) {
+			const uint64 half = n / 2;
+			return sum_pairwise<ACC>(data, half) + sum_pairwise<ACC>(data + half, n - half);
+		}
+
+		constexpr uint64 lanes = 8;
+		ACC              acc[lanes]{};
+		uint64           i = 0;
+#if defined(__GNUC__)
+		if (!__builtin_is_constant_evaluated()) {
+			using VA = vector<ACC, lanes>;
+			using VT = vector<T, lanes>;
+
+			VA v_acc = {};
+			for (; i + lanes <= n; i += lanes) {
+				VT v;
+				load(v, data + i);
+				v_acc += __builtin_convertvector(v, VA);
+			}
+			for (uint64 j = 0; j < lanes; j++) { acc[j] = v_acc[j]; }
+		}
+#endif
+		for (; i + lanes <= n; i += lanes) {
+			for (uint64 j = 0; j < lanes; j++) { acc[j] += ACC(data[i + j]); }
+		}
+		for (uint64 width = lanes / 2; width > 0; width /= 2) {
+			for (uint64 j = 0; j < width; j++) { acc[j] += acc[j + width]; }
+		}
+		ACC result = acc[0];
+		for (; i < n; i++) { result += ACC(data[i]); }
+		return result;
+	}
+
+	template<typename ACC, Arithmetic T>
+		requires Arithmetic<ACC>
+	constexpr ACC sum(const T *data, uint64 n) {
+		if constexpr (Float<ACC>) { return sum_pairwise<ACC>(data, n); }
+		if constexpr (Integer<ACC>) { return sum_integer<ACC>(data, n); }
+	}
+
+#if defined(__GNUC__) && __has_builtin(__builtin_shufflevector)
+	// v[i] = v[0] + ... + v[i] in log2(lanes) steps, each one adds the vector shifted up by a power of two.
+	template<typename V>
+	inline void scan_lanes(V &v) {
+		const V zero = {};
+		if constexpr (sizeof(V) / sizeof(v[0]) == 4) {
+			v += __builtin_shufflevector(zero, v, 0, 4, 5, 6);
+			v += __builtin_shufflevector(zero, v, 0, 1, 4, 5);
+		} else {
+			v += __builtin_shufflevector(zero, v, 0, 8, 9, 10, 11, 12, 13, 14);
+			v += __builtin_shufflevector(zero, v, 0, 1, 8, 9, 10, 11, 12, 13);
+			v += __builtin_shufflevector(zero, v, 0, 1, 2, 3, 8, 9, 10, 11);
+		}
+	}
+
+	// result += the last lane of v in every lane
+	template<typename V>
+	inline void add_last(V &result, const V &v) {
+		if constexpr (sizeof(V) / sizeof(v[0]) == 4) {
+			result += __builtin_shufflevector(v, v, 3, 3, 3, 3);
+		} else {
+			result += __builtin_shufflevector(v, v, 7, 7, 7, 7, 7, 7, 7, 7);
+		}
+	}
+#endif
+
+	/*
+	 * Running sums: out[i] = carry + data[0] + ... + data[i], without data[i] if not inclusive.
+	 * Returns carry plus all elements. out may be data.
+	 * Every vector is scanned in registers and the vectors of a group independently of each other,
+	 * only the add of the running carry depends on the previous vector. Integers only, so the result
+	 * is the same as the one of the scalar loop.
+	 */
+	template<bool inclusive, typename ACC, Integer T>
+		requires Integer<ACC>
+	constexpr ACC prefix_sum(const T *data, uint64 n, ACC *out, ACC carry) {
+		uint64 i = 0;
+#if defined(__GNUC__) && __has_builtin(__builtin_shufflevector)
+		constexpr uint64 lanes = vector_bytes / sizeof(ACC);
+		if constexpr (lanes == 4 || lanes == 8) {
+			if (!__builtin_is_constant_evaluated()) {
+				using VA = vector<ACC, lanes>;
+				using VT = vector<T, lanes>;
+
+				VA c = {};
+				c += carry;
+				for (; i + accumulators * lanes <= n; i += accumulators * lanes) {
+					VA v[accumulators];
+					VA scanned[accumulators];
+					for (uint64 k = 0; k < accumulators; k++) {
+						VT t;
+						load(t, data + i + k * lanes);
+						v[k]       = __builtin_convertvector(t, VA);
+						scanned[k] = v[k];
+						scan_lanes(scanned[k]);
+					}
+					for (uint64 k = 0; k < accumulators; k++) {
+						VA result = scanned[k] + c;
+						if constexpr (!inclusive) { result -= v[k]; }
+						__builtin_memcpy(out + i + k * lanes, &result, sizeof(VA));
+						add_last(c, scanned[k]);
+					}
+				}
+				carry = c[0];
+			}
+		}
+#endif
+		for (; i < n; i++) {
+			const ACC e = ACC(data[i]);
+			if constexpr (!inclusive) { out[i] = carry; }
+			carry += e;
+			if constexpr (inclusive) { out[i] = carry; }
+		}
+		return carry;
+	}
+
+	template<typename T>
+	struct minmax_pair {
+		T min;
+		T max;
+	};
+
+	/*
+	 * min, max and minmax require n > 0.
+	 */
+	template<Arithmetic T>
+	constexpr minmax_pair<T> minmax(const T *data, uint64 n) {
+		minmax_pair<T> result = {data[0], data[0]};
+		uint64         i      = 0;
+#if defined(__GNUC__)
+		constexpr uint64 lanes = vector_bytes / sizeof(T);
+		using V                = vector<T, lanes>;
+		if (!__builtin_is_constant_evaluated() && n >= accumulators * lanes) {
+			V lo[accumulators];
+			V hi[accumulators];
+			for (uint64 k = 0; k < accumulators; k++) {
+				load(lo[k], data + k * lanes);
+				hi[k] = lo[k];
+			}
+			for (i = accumulators * lanes; i + accumulators * lanes <= n; i += accumulators * lanes) {
+				for (uint64 k = 0; k < accumulators; k++) {
+					V v;
+					load(v, data + i + k * lanes);
+					lo[k] = v < lo[k] ? v : lo[k];
+					hi[k] = hi[k] < v ? v : hi[k];
+				}
+			}
+			for (uint64 k = 1; k < accumulators; k++) {
+				lo[0] = lo[k] < lo[0] ? lo[k] : lo[0];
+				hi[0] = hi[0] < hi[k] ? hi[k] : hi[0];
+			}
+			for (uint64 j = 0; j < lanes; j++) {
+				result.min = min_op(result.min, lo[0][j]);
+				result.max = max_op(result.max, hi[0][j]);
+			}
+		}
+#endif
+		for (; i < n; i++) {
+			result.min = min_op(result.min, data[i]);
+			result.max = max_op(result.max, data[i]);
+		}
+		return result;
+	}
+
+	template<Arithmetic T>
+	constexpr T min(const T *data, uint64 n) {
+		T      result = data[0];
+		uint64 i      = 0;
+#if defined(__GNUC__)
+		constexpr uint64 lanes = vector_bytes / sizeof(T);
+		using V                = vector<T, lanes>;
+		if (!__builtin_is_constant_evaluated() && n >= accumulators * lanes) {
+			V acc[accumulators];
+			for (uint64 k = 0; k < accumulators; k++) { load(acc[k], data + k * lanes); }
+			for (i = accumulators * lanes; i + accumulators * lanes <= n; i += accumulators * lanes) {
+				for (uint64 k = 0; k < accumulators; k++) {
+					V v;
+					load(v, data + i + k * lanes);
+					acc[k] = v < acc[k] ? v : acc[k];
+				}
+			}
+			for (uint64 k = 1; k < accumulators; k++) { acc[0] = acc[k] < acc[0] ? acc[k] : acc[0]; }
+			for (uint64 j = 0; j < lanes; j++) { result = min_op(result, acc[0][j]); }
+		}
+#endif
+		for (; i < n; i++) { result = min_op(result, data[i]); }
+		return result;
+	}
+
+	template<Arithmetic T>
+	constexpr T max(const T *data, uint64 n) {
+		T      result = data[0];
+		uint64 i      = 0;
+#if defined(__GNUC__)
+		constexpr uint64 lanes = vector_bytes / sizeof(T);
+		using V                = vector<T, lanes>;
+		if (!__builtin_is_constant_evaluated() && n >= accumulators * lanes) {
+			V acc[accumulators];
+			for (uint64 k = 0; k < accumulators; k++) { load(acc[k], data + k * lanes); }
+			for (i = accumulators * lanes; i + accumulators * lanes <= n; i += accumulators * lanes) {
+				for (uint64 k = 0; k < accumulators; k++) {
+					V v;
+					load(v, data + i + k * lanes);
+					acc[k] = acc[k] < v ? v : acc[k];
+				}
+			}
+			for (uint64 k = 1; k < accumulators; k++) { acc[0] = acc[0] < acc[k] ? acc[k] : acc[0]; }
+			for (uint64 j = 0; j < lanes; j++) { result = max_op(result, acc[0][j]); }
+		}
+#endif
+		for (; i < n; i++) { result = max_op(result, data[i]); }
+		return result;
+	}
+
+	// Index of the first element equal to value, n if there is none.
+	template<typename T>
+	constexpr uint64 find(const T *data, uint64 n, T value) {
+		for (uint64 i = 0; i < n; i++) {
+			if (data[i] == value) { return i; }
+		}
+		return n;
+	}
+
+	/*
+	 * NUL-terminated strings are scanned 8 bytes at a time.
+	 * A byte is zero, if (word - 0x01..01) & ~word & 0x80..80 has its high bit set. Only the bytes above a zero
+	 * byte can be false positives, so on little endian the lowest set bit is exactly the first zero byte.
+	 * Long strings are tested 128 bytes at a time with vector compares first.
+	 * The loads are aligned, so they never cross into another page and can't fault, even though they read past
+	 * the terminator. That's also why the address sanitizer is disabled for them, like for the libc strlen.
+	 */
+	inline constexpr uint64 byte_ones  = 0x0101010101010101ULL;
+	inline constexpr uint64 byte_highs = 0x8080808080808080ULL;
+
+	constexpr uint64 zero_bytes(uint64 word) { return (word - byte_ones) & ~word & byte_highs; }
+
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	__attribute__((no_sanitize("address"))) inline uint64
+	c_string_scan_words(const char *str, uint64 n, char c) {
+		// Plain aligned loads, a memcpy could end up in the sanitizer's interceptor.
+		typedef uint64 word_t __attribute__((may_alias));
+		typedef uint8  vector_t __attribute__((vector_size(vector_bytes), may_alias));
+
+		constexpr uint64 step      = 4 * vector_bytes;
+		const uint64     pattern   = byte_ones * uint8(c);
+		const vector_t   zero      = {};
+		const vector_t   pattern_v = zero + uint8(c);
+
+		const uint64 misalign = uint64(reinterpret_cast<__UINTPTR_TYPE__>(str)) & 7;
+		const char  *aligned  = str - misalign;
+
+		// The bytes in front of the string are set to 0xFF, so they can't match or cause a false positive.
+		const uint64 before = (1ULL << (misalign * 8)) - 1;
+		uint64       word   = *reinterpret_cast<const word_t *>(aligned);
+		uint64       hits   = zero_bytes(word | before) | zero_bytes((word ^ pattern) | before);
+
+		uint64 offset = 0;
+		// Single words until the next 128 byte boundary, then 128 bytes per step, which stay in one page.
+		while (hits == 0 && offset + 8 - misalign < n
+			   && ((reinterpret_cast<__UINTPTR_TYPE__>(aligned) + offset + 8) & (step - 1)) != 0) {
+			offset += 8;
+			word = *reinterpret_cast<const word_t *>(aligned + offset);
+			hits = zero_bytes(word) | zero_bytes(word ^ pattern);
+		}
+		while (hits == 0 && offset + 8 - misalign < n) {
+			const auto *v       = reinterpret_cast<const vector_t *>(aligned + offset + 8);
+			auto        matches = (v[0] == zero) | (v[0] == pattern_v);
+			for (uint64 k = 1; k < step / vector_bytes; k++) {
+				matches |= (v[k] == zero) | (v[k] == pattern_v);
+			}
+			const auto *lanes = reinterpret_cast<const word_t *>(&matches);
+			uint64      any   = 0;
+			for (uint64 k = 0; k < vector_bytes / 8; k++) { any |= lanes[k]; }
+			if (any == 0) {
+				offset += step;
+				continue;
+			}
+			for (uint64 k = 0; k < step / 8 && hits == 0; k++) {
+				offset += 8;
+				word = *reinterpret_cast<const word_t *>(aligned + offset);
+				hits = zero_bytes(word) | zero_bytes(word ^ pattern);
+			}
+		}
+		if (hits == 0) { return n; }
+		const uint64 index = offset + uint64(__builtin_ctzll(hits)) / 8 - misalign;
+		return index < n ? index : n;
+	}
+#endif
+
+	// Index of the first c or terminator among the first n bytes of str, n if there is none.
+	constexpr uint64 c_string_scan(const char *str, uint64 n, char c) {
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		if (!__builtin_is_constant_evaluated()) { return c_string_scan_words(str, n, c); }
+#endif
+		for (uint64 i = 0; i < n; i++) {
+			if (str[i] == c || str[i] == '\0') { return i; }
+		}
+		return n;
+	}
+
+	constexpr uint64 strlen(const char *str) { return c_string_scan(str, ~0ULL, '\0'); }
+
+	/*
+	 * Delimiters in bounded text are found 64 bytes at a time: the bytes are compared with vector compares
+	 * and turned into a 64 bit mask, bit i set if data[i] == c, with pmovmskb on x86.
+	 * Without SSE2 the mask is built from the exact SWAR zero byte test of 8 byte words,
+	 * whose high bits are gathered into one byte with a multiplication.
+	 * The caller scans the mask with ctz and counts it with popcount, so nothing is tested a byte at a time.
+	 */
+	inline constexpr uint64 mask_bytes = 64;
+
+	constexpr uint64 equal_bytes(uint64 word, uint64 pattern) {
+		const uint64 t = word ^ pattern;
+		return ~(((t & ~byte_highs) + ~byte_highs) | t) & byte_highs;
+	}
+
+	// Bit i is set if data[i] == c, for n <= 64 bytes.
+	constexpr uint64 equal_mask(const char *data, uint64 n, char c) {
+		uint64 mask = 0;
+		uint64 i    = 0;
+		if (!__builtin_is_constant_evaluated() && n == mask_bytes) {
+#if defined(__GNUC__) && defined(__AVX2__)
+			typedef char v32 __attribute__((vector_size(32)));
+			v32          low, high;
+			load(low, data);
+			load(high, data + 32);
+			const v32 pattern = v32{} + c;
+			return uint64(uint32(__builtin_ia32_pmovmskb256(v32(low == pattern))))
+				   | uint64(uint32(__builtin_ia32_pmovmskb256(v32(high == pattern)))) << 32;
+#elif defined(__GNUC__) && defined(__SSE2__)
+			typedef char v16 __attribute__((vector_size(16)));
+			const v16    pattern = v16{} + c;
+			for (uint64 k = 0; k < mask_bytes; k += 16) {
+				v16 v;
+				load(v, data + k);
+				mask |= uint64(uint16(__builtin_ia32_pmovmskb128(v16(v == pattern)))) << k;
+			}
+			return mask;
+#elif __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			const uint64 pattern = byte_ones * uint8(c);
+			for (; i < mask_bytes; i += 8) {
+				uint64 word;
+				__builtin_memcpy(&word, data + i, 8);
+				mask |= ((equal_bytes(word, pattern) >> 7) * 0x0102040810204080ULL) >> 56 << i;
+			}
+			return mask;
+#endif
+		}
+		for (; i < n; i++) { mask |= uint64(data[i] == c) << i; }
+		return mask;
+	}
+
+	// Index of the first c among the first n bytes of data, n if there is none.
+	constexpr uint64 find_byte(const char *data, uint64 n, char c) {
+		for (uint64 i = 0; i < n; i += mask_bytes) {
+			const uint64 mask = equal_mask(data + i, min_op(mask_bytes, n - i), c);
+			if (mask != 0) { return i + uint64(__builtin_ctzll(mask)); }
+		}
+		return n;
+	}
+
+	constexpr uint64 count_byte(const char *data, uint64 n, char c) {
+		uint64 result = 0;
+		for (uint64 i = 0; i < n; i += mask_bytes) {
+			result += uint64(__builtin_popcountll(equal_mask(data + i, min_op(mask_bytes, n - i), c)));
+		}
+		return result;
+	}
+
+	/*
+	 * Hash tables keep one control byte per slot and probe them in groups of 16,
+	 * so a lookup compares a whole group with the searched byte in one SSE2 compare.
+	 */
+	inline constexpr uint64 group_bytes = 16;
+
+	// Bit i is set if group[i] == c.
+	constexpr uint32 match_group(const uint8 *group, uint8 c) {
+		uint32 mask = 0;
+		if (!__builtin_is_constant_evaluated()) {
+#if defined(__GNUC__) && defined(__SSE2__)
+			typedef char v16 __attribute__((vector_size(16)));
+			v16          v;
+			load(v, group);
+			return uint32(uint16(__builtin_ia32_pmovmskb128(v16(v == v16{} + char(c)))));
+#elif __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			const uint64 pattern = byte_ones * c;
+			for (uint64 i = 0; i < group_bytes; i += 8) {
+				uint64 word;
+				__builtin_memcpy(&word, group + i, 8);
+				mask |= uint32(((equal_bytes(word, pattern) >> 7) * 0x0102040810204080ULL) >> 56 << i);
+			}
+			return mask;
+#endif
+		}
+		for (uint64 i = 0; i < group_bytes; i++) { mask |= uint32(group[i] == c) << i; }
+		return mask;
+	}
+
+	/*
+	 * A selection vector holds one byte per element of a block, 1 if it passes a filter and 0 otherwise.
+	 * The predicate is evaluated for every element without a branch, so the selectivity doesn't cause mispredictions.
+	 * Bytes instead of bits keep both the producer and the consumers plain vectorizable loops.
+	 */
+	template<typename T, typename P>
+	constexpr void select(const T *data, uint64 n, uint8 *selected, P predicate) {
+		for (uint64 i = 0; i < n; i++) { selected[i] = predicate(data[i]) ? 1 : 0; }
+	}
+
+	constexpr uint64 count_selected(const uint8 *selected, uint64 n) {
+		uint64 result = 0;
+		uint32 acc    = 0; // narrow accumulator, so the loop vectorizes with wide lanes
+		for (uint64 i = 0; i < n; i++) { acc += selected[i]; }
+		result += acc;
+		return result;
+	}
+
+	/*
+	 * Copies the selected elements in order to out and returns their number.
+	 * out may alias data, since the output never overtakes the input.
+	 * Groups of 8 elements without a selected one are skipped as a whole, others are copied without a branch.
+	 */
+	template<typename T>
+	constexpr uint64 compress(const T *data, uint64 n, const uint8 *selected, T *out) {
+		uint64 written = 0;
+		uint64 i       = 0;
+		for (; i + 8 <= n; i += 8) {
+			uint64 group = 0;
+			for (uint64 j = 0; j < 8; j++) { group |= uint64(selected[i + j]) << (j * 8); }
+			if (group == 0) { continue; }
+			for (uint64 j = 0; j < 8; j++) {
+				out[written] = data[i + j];
+				written += selected[i + j];
+			}
+		}
+		for (; i < n; i++) {
+			out[written] = data[i];
+			written += selected[i];
+		}
+		return written;
+	}
+
+	// Copies data to out with the elements that aren't selected replaced by zero.
+	template<Arithmetic T>
+	constexpr void zero_unselected(const T *data, uint64 n, const uint8 *selected, T *out) {
+		for (uint64 i = 0; i < n; i++) { out[i] = selected[i] ? data[i] : T(0); }
+	}
+
+	/*
+	 * Pairwise summation over a stream of partial sums.
+	 * It works like a binary counter, two partial sums are only added if they cover the same number of inputs.
+	 */
+	template<Float T>
+	struct pairwise_accumulator {
+		T      partial[64]{};
+		uint64 counter = 0;
+
+		constexpr void add(T value) {
+			uint64 level = 0;
+			while ((counter >> level) & 1) {
+				value = partial[level] + value;
+				level++;
+			}
+			partial[level] = value;
+			counter++;
+		}
+
+		[[nodiscard]] constexpr T result() const {
+			T result = 0;
+			for (uint64 level = 0; level < 64; level++) {
+				if ((counter >> level) & 1) { result = partial[level] + result; }
+			}
+			return result;
+		}
+	};
+
+} // namespace simd
+
+#endif //D_ITERATOR_SIMD_H
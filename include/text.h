@@ -0,0 +1,128 @@
+//
+// Created by af on 16/10/26.
+//
+
+#ifndef D_ITERATOR_TEXT_H
+#define D_ITERATOR_TEXT_H
+
+#include "array.h"
+
+/*
+ * Splitting contiguous text, e.g. an array_view of a mapped file, into fields or lines.
+ * The fields are array_views into the text, nothing is copied, so the text has to outlive them.
+ *
+ * Delimiters are found 64 bytes at a time with simd::equal_mask. The mask of the current 64 bytes is kept,
+ * so the next delimiter is the lowest bit above the current one and every byte is compared only once.
+ * count() is the popcount of the masks of the remaining text.
+ */
+namespace it {
+
+	/*
+	 * split yields the fields between delimiters, n delimiters separate n + 1 fields, some of them empty.
+	 * split_lines ends every line with a delimiter, so a trailing newline doesn't start another, empty line.
+	 * Empty text has no fields and no lines.
+	 */
+	template<bool lines>
+	struct _i_split_iterator : cpp_iterator_adapter<_i_split_iterator<lines>> {
+		using value_type = array_view<char>;
+
+		const char *_pos;              // start of the current field, nullptr once exhausted
+		const char *_next;             // the delimiter that ends it, or _end
+		const char *_end;
+		const char *_window = nullptr; // 64 bytes, the bits of the delimiters up to _next are cleared in _mask
+		uint64      _mask   = 0;
+		char        _delimiter;
+
+		constexpr _i_split_iterator(const char *data, uint64 size, char delimiter)
+			: _pos(size == 0 ? nullptr : data), _next(data), _end(data + size), _window(data),
+			  _delimiter(delimiter) {
+			if (size != 0) {
+				_mask = simd::equal_mask(data, min(simd::mask_bytes, size), delimiter);
+				_next = find_next();
+			}
+		}
+
+		[[nodiscard]] constexpr bool has_next() const { return _pos != nullptr; }
+
+		constexpr value_type operator*() const { return {_pos, uint64(_next - _pos)}; }
+
+		constexpr void operator++() {
+			if (_next == _end || (lines && _next + 1 == _end)) {
+				_pos = nullptr;
+				return;
+			}
+			_pos  = _next + 1;
+			_next = find_next();
+		}
+
+		// The lowest delimiter bit in the current window, or the first delimiter of the following windows.
+		constexpr const char *find_next() {
+			while (_mask == 0) {
+				if (uint64(_end - _window) <= simd::mask_bytes) { return _end; }
+				_window += simd::mask_bytes;
+				_mask = simd::equal_mask(_window, min(simd::mask_bytes, uint64(_end - _window)), _delimiter);
+			}
+			const uint64 bit = uint64(__builtin_ctzll(_mask));
+			_mask &= _mask - 1;
+			return _window + bit;
+		}
+
+		// The delimiters left in the current window are popcounted, the rest of the text is counted from scratch.
+		[[nodiscard]] constexpr uint64 count() const {
+			if (_pos == nullptr) { return 0; }
+			uint64 delimiters = (_next != _end ? 1 : 0) + uint64(__builtin_popcountll(_mask));
+			if (uint64(_end - _window) > simd::mask_bytes) {
+				delimiters += simd::count_byte(_window + simd::mask_bytes,
+											   uint64(_end - _window) - simd::mask_bytes, _delimiter);
+			}
+			if constexpr (lines) { return delimiters + (_end[-1] != _delimiter ? 1 : 0); }
+			return delimiters + 1;
+		}
+
+		constexpr block<value_type> next_block(value_type *buffer, uint64 n) {
+			uint64 m = 0;
+			for (; m < n && has_next(); m++) {
+				buffer[m] = **this;
+				++*this;
+			}
+			return {buffer, m};
+		}
+	};
+
+	constexpr auto split(const char *data, uint64 size, char delimiter) {
+		return _i_split_iterator<false>(data, size, delimiter);
+	}
+	template<ContiguousIterator CI>
+		requires is_same_v<typename CI::value_type, char>
+	constexpr auto split(CI it, char delimiter) {
+		return split(it.data(), it.count(), delimiter);
+	}
+	struct split_ {
+		char _delimiter;
+	};
+	constexpr auto split(char delimiter) { return split_{delimiter}; }
+	template<ContiguousIterator CI>
+		requires is_same_v<typename CI::value_type, char>
+	constexpr auto operator|(CI it, split_ delimiter) {
+		return split(it, delimiter._delimiter);
+	}
+
+	constexpr auto split_lines(const char *data, uint64 size) {
+		return _i_split_iterator<true>(data, size, '\n');
+	}
+	template<ContiguousIterator CI>
+		requires is_same_v<typename CI::value_type, char>
+	constexpr auto split_lines(CI it) {
+		return split_lines(it.data(), it.count());
+	}
+	struct split_lines_ {};
+	constexpr auto split_lines() { return split_lines_{}; }
+	template<ContiguousIterator CI>
+		requires is_same_v<typename CI::value_type, char>
+	constexpr auto operator|(CI it, split_lines_) {
+		return split_lines(it);
+	}
+
+} // namespace it
+
+#endif //D_ITERATOR_TEXT_H
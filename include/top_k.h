@@ -0,0 +1,154 @@
+//
+// Created by af on 16/10/26.
+//
+
+#ifndef D_ITERATOR_TOP_K_H
+#define D_ITERATOR_TOP_K_H
+
+#include "array.h"
+
+/*
+ * The k largest elements of an iterator in one pass, without sorting or storing all of them.
+ * They are kept in a binary min heap of capacity k inside the result, so nothing is allocated,
+ * and the smallest kept element at the root is the threshold a new element has to beat.
+ * At the end the heap is sorted in place, so the result is ordered from the largest element down.
+ *
+ * Once the heap is full, blocks are first compared with the threshold into a selection vector without a branch,
+ * blocks without a candidate are skipped as a whole. Late in a long input nearly all blocks are skipped,
+ * so the cost approaches a vectorized scan instead of n heap operations.
+ */
+namespace algo {
+
+	using it::_i_less;
+
+	template<typename T, uint64 K>
+		requires(K > 0)
+	struct top_k_result {
+		T      _data[K];
+		uint64 _size = 0;
+
+		[[nodiscard]] constexpr uint64 count() const { return _size; }
+
+		constexpr T operator[](uint64 i) const { return _data[i]; }
+
+		[[nodiscard]] constexpr array_view<T> view() const { return {_data, _size}; }
+
+		[[nodiscard]] constexpr array_view<T> to_iterator() const { return view(); }
+
+		// Heap order, before sort() the root _data[0] is the smallest kept element.
+		// A heap of one element is already sorted, and the loops would index past _data.
+		template<class CMP>
+		constexpr void sift_down(uint64 i, CMP cmp) {
+			if constexpr (K > 1) {
+				const T element = _data[i];
+				while (2 * i + 1 < _size) {
+					uint64 child = 2 * i + 1;
+					if (child + 1 < _size && cmp(_data[child + 1], _data[child])) { child++; }
+					if (!cmp(_data[child], element)) { break; }
+					_data[i] = _data[child];
+					i        = child;
+				}
+				_data[i] = element;
+			}
+		}
+
+		template<class CMP>
+		constexpr void push(T element, CMP cmp) {
+			uint64 i = _size++;
+			while (i > 0 && cmp(element, _data[(i - 1) / 2])) {
+				_data[i] = _data[(i - 1) / 2];
+				i        = (i - 1) / 2;
+			}
+			_data[i] = element;
+		}
+
+		// Keeps the element, if it is larger than the smallest one or the heap isn't full yet.
+		template<class CMP>
+		constexpr void offer(T element, CMP cmp) {
+			if (_size < K) {
+				push(element, cmp);
+			} else if (cmp(_data[0], element)) {
+				_data[0] = element;
+				sift_down(0, cmp);
+			}
+		}
+
+		// Heap sort, the smallest element is moved to the back first.
+		template<class CMP>
+		constexpr void sort(CMP cmp) {
+			if constexpr (K > 1) {
+				const uint64 size = _size;
+				while (_size > 1) {
+					const T smallest = _data[0];
+					_data[0]         = _data[--_size];
+					sift_down(0, cmp);
+					_data[_size] = smallest;
+				}
+				_size = size;
+			}
+		}
+	};
+
+	// The K largest elements by cmp, sorted from the largest down.
+	// Which of equal elements are kept is unspecified.
+	template<uint64 K, it::CustomIterator CI, class CMP = _i_less>
+	constexpr auto top_k(CI it, CMP cmp = {}) {
+		using T = it::remove_reference_t<typename CI::value_type>;
+		top_k_result<T, K> result;
+		if constexpr (it::BlockIterator<CI>) {
+			T     buffer[it::block_size];
+			uint8 selected[it::block_size];
+			for (auto b = it.next_block(buffer, it::block_size); b.size != 0;
+				 b      = it.next_block(buffer, it::block_size)) {
+				uint64 i = 0;
+				for (; i < b.size && result._size < K; i++) { result.push(b.data[i], cmp); }
+				if (i == b.size) { continue; }
+
+				// An element that doesn't beat the threshold of the block start can't beat a later one.
+				const T threshold = result._data[0];
+				simd::select(b.data + i, b.size - i, selected, [&](T e) { return cmp(threshold, e); });
+				if (simd::count_selected(selected, b.size - i) == 0) { continue; }
+				for (uint64 j = 0; j < b.size - i; j++) {
+					if (selected[j]) { result.offer(b.data[i + j], cmp); }
+				}
+			}
+		} else {
+			while (it.has_next()) {
+				result.offer(*it, cmp);
+				++it;
+			}
+		}
+		result.sort(cmp);
+		return result;
+	}
+	template<uint64 K, class CMP>
+	struct top_k_ {
+		CMP _cmp;
+	};
+	template<uint64 K, class CMP = _i_less>
+		requires(!it::CustomIterator<CMP>)
+	constexpr auto top_k(CMP cmp = {}) {
+		return top_k_<K, CMP>{cmp};
+	}
+	template<it::CustomIterator CI, uint64 K, class CMP>
+	constexpr auto operator|(CI it, top_k_<K, CMP> top) {
+		return top_k<K>(it, top._cmp);
+	}
+
+	// The K largest of two sorted results, e.g. of two halves of the input.
+	template<typename T, uint64 K, class CMP = _i_less>
+	constexpr top_k_result<T, K> merge_top_k(const top_k_result<T, K> &a, const top_k_result<T, K> &b,
+											 CMP cmp = {}) {
+		top_k_result<T, K> result;
+		uint64             i = 0;
+		uint64             j = 0;
+		while (result._size < K && (i < a._size || j < b._size)) {
+			const bool from_b = i == a._size || (j < b._size && cmp(a._data[i], b._data[j]));
+			result._data[result._size++] = from_b ? b._data[j++] : a._data[i++];
+		}
+		return result;
+	}
+
+} // namespace algo
+
+#endif //D_ITERATOR_TOP_K_H
@@ -0,0 +1,237 @@
+//
+// Created by af on 16/10/26.
+//
+
+#ifndef D_ITERATOR_WINDOW_H
+#define D_ITERATOR_WINDOW_H
+
+#include "array.h"
+
+/*
+ * Sliding windows of the last W elements, W known at compile time, in a ring buffer inside the iterator.
+ * Nothing is allocated and every element is read from the source once.
+ * Only full windows are yielded, so n elements give n - W + 1 windows, or none if n < W.
+ *
+ * window<W>() yields each window as an array_view. Every element is stored twice, at i and i + W,
+ * so the window is always contiguous in the ring. The view is valid until the iterator advances.
+ *
+ * rolling<W>(agg) yields one aggregate per window, updated incrementally in amortized O(1):
+ * rolling_sum and rolling_mean add the new element and subtract the one that leaves the window,
+ * rolling_min and rolling_max combine the extremes of a block suffix and a block prefix (van Herk/Gil-Werman).
+ * Floating point sums are updated like any running sum, so their rounding errors accumulate.
+ */
+namespace it {
+
+	template<CustomIterator CI, uint64 W>
+		requires(W > 0) && BlockValue<remove_reference_t<typename CI::value_type>>
+	struct _i_WindowIterator : cpp_iterator_adapter<_i_WindowIterator<CI, W>> {
+		using T          = remove_reference_t<typename CI::value_type>;
+		using value_type = array_view<T>;
+		static constexpr bool costly_count() { return CostlyCount<CI>; }
+
+		CI     _it;
+		T      _ring[2 * W];
+		uint64 _pos  = 0; // the oldest element of the window
+		bool   _full = false;
+
+		constexpr explicit _i_WindowIterator(CI it) : _it(it) {
+			uint64 n = 0;
+			for (; n < W && _it.has_next(); n++) {
+				push(*_it);
+				++_it;
+			}
+			_full = n == W;
+		}
+
+		constexpr void push(T element) {
+			_ring[_pos]     = element;
+			_ring[_pos + W] = element;
+			_pos            = _pos + 1 == W ? 0 : _pos + 1;
+		}
+
+		constexpr void operator++() {
+			_full = _it.has_next();
+			if (!_full) { return; }
+			push(*_it);
+			++_it;
+		}
+
+		constexpr value_type operator*() const { return {_ring + _pos, W}; }
+
+		[[nodiscard]] constexpr bool has_next() const { return _full; }
+
+		[[nodiscard]] constexpr uint64 count() const
+			requires CountingIterator<CI>
+		{
+			return _full ? _it.count() + 1 : 0;
+		}
+	};
+
+	template<uint64 W>
+	struct window_ {};
+	template<uint64 W>
+	constexpr auto window() {
+		return window_<W>{};
+	}
+	template<CustomIterator CI, uint64 W>
+	constexpr auto operator|(CI it, window_<W>) {
+		return _i_WindowIterator<CI, W>(it);
+	}
+
+	/*
+	 * Aggregate protocol: AGG::state<T, W> gets add(in, index) for every element and remove(out, index)
+	 * for every element that leaves the window, index counts the elements from 0.
+	 * value() is the aggregate of the current window.
+	 */
+	struct rolling_sum {
+		template<typename T, uint64 W>
+		struct state {
+			T sum = T();
+
+			constexpr void add(T in, uint64) { sum += in; }
+			constexpr void remove(T out, uint64) { sum -= out; }
+			[[nodiscard]] constexpr T value() const { return sum; }
+		};
+	};
+
+	struct rolling_mean {
+		template<typename T, uint64 W>
+		struct state {
+			double sum = 0;
+
+			constexpr void add(T in, uint64) { sum += double(in); }
+			constexpr void remove(T out, uint64) { sum -= double(out); }
+			[[nodiscard]] constexpr double value() const { return sum / double(W); }
+		};
+	};
+
+	/*
+	 * van Herk/Gil-Werman: the elements are cut into blocks of W. A window spans the end of one block
+	 * and the start of the next, so its extreme is that of a suffix of the previous block and a prefix
+	 * of the current one. The suffix extremes of a block are computed once it is complete,
+	 * the prefix extreme is kept while the next one fills, so every element costs three comparisons
+	 * and no branch that depends on the data.
+	 */
+	template<bool max>
+	struct _i_rolling_extreme {
+		template<typename T, uint64 W>
+		struct state {
+			T      current[W]; // the block that is filled
+			T      suffix[W];  // suffix[i] is the extreme of the previous block from i on
+			T      prefix = T();
+			uint64 last   = 0; // the position of the newest element in its block
+
+			[[nodiscard]] static constexpr T extreme(T a, T b) {
+				if constexpr (max) { return a < b ? b : a; }
+				return b < a ? b : a;
+			}
+
+			constexpr void add(T in, uint64 index) {
+				last = index % W;
+				if (last == 0) {
+					if (index != 0) {
+						suffix[W - 1] = current[W - 1];
+						for (uint64 i = W - 1; i > 0; i--) { suffix[i - 1] = extreme(current[i - 1], suffix[i]); }
+					}
+					prefix = in;
+				}
+				prefix        = extreme(prefix, in);
+				current[last] = in;
+			}
+
+			constexpr void remove(T, uint64) {}
+
+			// At the end of a block the window is exactly that block.
+			[[nodiscard]] constexpr T value() const {
+				if (last == W - 1) { return prefix; }
+				return extreme(suffix[last + 1], prefix);
+			}
+		};
+	};
+	using rolling_min = _i_rolling_extreme<false>;
+	using rolling_max = _i_rolling_extreme<true>;
+
+	template<CustomIterator CI, uint64 W, class AGG>
+		requires(W > 0) && BlockValue<remove_reference_t<typename CI::value_type>>
+	struct _i_RollingIterator : cpp_iterator_adapter<_i_RollingIterator<CI, W, AGG>> {
+		using T          = remove_reference_t<typename CI::value_type>;
+		using state_t    = typename AGG::template state<T, W>;
+		using value_type = decltype(_declare_val<const state_t &>().value());
+		static constexpr bool costly_count() { return CostlyCount<CI>; }
+
+		CI      _it;
+		T       _ring[W];
+		uint64  _pos  = 0; // the oldest element of the window
+		uint64  _seen = 0;
+		state_t _state;
+		bool    _full = false;
+
+		constexpr explicit _i_RollingIterator(CI it) : _it(it) {
+			while (_seen < W && _it.has_next()) {
+				push(*_it);
+				++_it;
+			}
+			_full = _seen == W;
+		}
+
+		// The element that leaves the window is removed first.
+		constexpr void push(T element) {
+			if (_seen >= W) { _state.remove(_ring[_pos], _seen - W); }
+			_state.add(element, _seen);
+			_ring[_pos] = element;
+			_pos        = _pos + 1 == W ? 0 : _pos + 1;
+			_seen++;
+		}
+
+		constexpr void operator++() {
+			_full = _it.has_next();
+			if (!_full) { return; }
+			push(*_it);
+			++_it;
+		}
+
+		constexpr value_type operator*() const { return _state.value(); }
+
+		[[nodiscard]] constexpr bool has_next() const { return _full; }
+
+		[[nodiscard]] constexpr uint64 count() const
+			requires CountingIterator<CI>
+		{
+			return _full ? _it.count() + 1 : 0;
+		}
+
+		// The source is read in blocks, the aggregates are still computed one element after the other.
+		constexpr block<value_type> next_block(value_type *buffer, uint64 n)
+			requires BlockIterator<CI> && BlockValue<value_type>
+		{
+			if (!_full || n == 0) { return {buffer, 0}; }
+			T      in[block_size];
+			uint64 m    = 0;
+			buffer[m++] = _state.value();
+			while (m < n) {
+				const auto b = _it.next_block(in, min(n - m, block_size));
+				if (b.size == 0) { break; }
+				for (uint64 i = 0; i < b.size; i++) {
+					push(b.data[i]);
+					buffer[m++] = _state.value();
+				}
+			}
+			++*this;
+			return {buffer, m};
+		}
+	};
+
+	template<uint64 W, class AGG>
+	struct rolling_ {};
+	template<uint64 W, class AGG>
+	constexpr auto rolling(AGG) {
+		return rolling_<W, AGG>{};
+	}
+	template<CustomIterator CI, uint64 W, class AGG>
+	constexpr auto operator|(CI it, rolling_<W, AGG>) {
+		return _i_RollingIterator<CI, W, AGG>(it);
+	}
+
+} // namespace it
+
+#endif //D_ITERATOR_WINDOW_H
@@ -4,12 +4,28 @@
 
 // use Google test as unit test framework
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <gtest/gtest.h>
+#include <map>
+#include <numeric>
 #include <random>
+#include <set>
+#include <string>
 
 #define D_ITERATOR_UNIT_TEST
+#include "arena.h"
 #include "array.h"
+#include "fd_reader.h"
+#include "group_by.h"
 #include "iterator.h"
+#include "join.h"
+#include "mapped_file.h"
+#include "merge.h"
+#include "parallel.h"
+#include "text.h"
+#include "top_k.h"
+#include "window.h"
 
 
 TEST(array_iterator, array_iterator_int) {
@@ -322,6 +338,1251 @@ TEST(reversing_iterators, filter) {
 	}
 }
 
+TEST(block_iterator, pipeline) {
+	const uint64 len = 1000;
+	int          arr[len]{};
+
+	for (uint64 i = 0; i < len; i++) { arr[i] = int(i); }
+
+	auto it = it::iterator(arr, len) | it::filter([](int e) { return e % 3 == 0; })
+			| it::map([](int e) { return e * 2; }) | it::take(300);
+	static_assert(it::BlockIterator<decltype(it)>);
+
+	auto reference = it;
+	int  buffer[7];
+	for (auto b = it.next_block(buffer, 7); b.size != 0; b = it.next_block(buffer, 7)) {
+		ASSERT_LE(b.size, 7);
+		for (uint64 i = 0; i < b.size; i++) {
+			ASSERT_EQ(b.data[i], *reference);
+			++reference;
+		}
+	}
+	ASSERT_FALSE(it.has_next());
+	ASSERT_FALSE(reference.has_next());
+
+	auto seq = it::sequence_generator<int>(0, 10000);
+	ASSERT_EQ(algo::sum(seq | it::filter([](int e) { return e % 2 == 0; })), 24995000);
+	ASSERT_EQ(algo::count(seq | it::filter([](int e) { return e % 7 == 0; })), 1429);
+
+	auto zipped = it::zip(it::iterator(arr, len), seq)
+				| it::map([](auto p) { return p.first - p.second; });
+	ASSERT_EQ(algo::count(zipped | it::filter([](int e) { return e == 0; })), len);
+
+	auto appended = algo::to_array<std::vector<int>>(
+			it::append(it::iterator(arr, 3), it::sequence_generator<int>(3, 600)));
+	ASSERT_EQ(appended.size(), 600);
+	for (uint64 i = 0; i < appended.size(); i++) { ASSERT_EQ(appended[i], int(i)); }
+}
+
+TEST(simd_reduction, sum) {
+	std::vector<int> v;
+	for (int i = 0; i < 10007; i++) { v.push_back(i * 40009); }
+
+	int64 expected = 0;
+	for (const int e: v) { expected += e; }
+
+	const auto it = it::iterator(v.data(), v.size());
+	ASSERT_EQ(algo::sum<int64>(it), expected);
+	ASSERT_EQ(algo::sum(it), int(uint64(expected)));
+	ASSERT_EQ(it | it::map([](int e) { return int64(e) * 2; }) | algo::sum<int64>(), expected * 2);
+	ASSERT_EQ(algo::sum<int64>(it | it::caching_iterator()), expected);
+
+	std::vector<double> d;
+	for (int i = 0; i < 10007; i++) { d.push_back(1.0 / (i + 1)); }
+	double harmonic = 0;
+	for (const double e: d) { harmonic += e; }
+
+	const double simd_sum = algo::sum(it::iterator(d.data(), d.size()));
+	ASSERT_NEAR(simd_sum, harmonic, 1e-12);
+	ASSERT_EQ(simd_sum, algo::sum(it::iterator(d.data(), d.size())));
+	ASSERT_NEAR(algo::sum<double>(it::iterator(d.data(), d.size()) | it::map([](double e) {
+										  return float(e);
+									  })),
+				harmonic, 1e-5);
+}
+
+TEST(simd_reduction, min_max) {
+	std::vector<int> v;
+	for (int i = 0; i < 1000; i++) { v.push_back(i - 300); }
+	v = shuffle(v);
+	v.push_back(-300);
+
+	const auto it = it::iterator(v.data(), v.size());
+	ASSERT_EQ(algo::min(it), -300);
+	ASSERT_EQ(algo::max(it), 699);
+	ASSERT_EQ((it | algo::minmax()).min, -300);
+	ASSERT_EQ((it | algo::minmax()).max, 699);
+	ASSERT_EQ(v[it | algo::argmin()], -300);
+	ASSERT_NE(it | algo::argmin(), v.size() - 1);
+
+	auto squared = it | it::map([](int e) { return e * e; });
+	ASSERT_EQ(algo::min(squared), 0);
+	ASSERT_EQ(algo::max(squared), 699 * 699);
+	ASSERT_EQ(v[algo::argmin(squared)], 0);
+
+	auto small = it::iterator(v.data(), 3) | it::caching_iterator();
+	ASSERT_EQ(algo::min(small), it::min(v[0], it::min(v[1], v[2])));
+	ASSERT_EQ(algo::argmin(small), algo::argmin(it::iterator(v.data(), 3)));
+}
+
+TEST(selection_vector, selectivity) {
+	std::vector<int> v;
+	for (int i = 0; i < 10000; i++) { v.push_back(i % 100); }
+	v = shuffle(v);
+
+	const auto it = it::iterator(v.data(), v.size());
+	for (const int selectivity: {0, 1, 50, 99, 100}) {
+		auto filtered = it | it::filter([selectivity](int e) { return e < selectivity; });
+		static_assert(it::SelectionIterator<decltype(filtered)>);
+
+		uint64 count = 0;
+		int64  sum   = 0;
+		for (const int e: v) {
+			if (e < selectivity) {
+				count++;
+				sum += e;
+			}
+		}
+
+		ASSERT_EQ(algo::count(filtered), count);
+		ASSERT_EQ(algo::sum<int64>(filtered), sum);
+		ASSERT_EQ(filtered | it::map([](int e) { return int64(e); }) | algo::sum<int64>(), sum);
+
+		const auto compacted = algo::to_array<std::vector<int>>(filtered);
+		ASSERT_EQ(compacted.size(), count);
+		auto reference = filtered;
+		for (const int e: compacted) {
+			ASSERT_EQ(e, *reference);
+			++reference;
+		}
+	}
+}
+
+template<it::RandomAccessIterator CI>
+void expect_random_access_matches_linear(CI start, uint64 from) {
+	auto begin = start;
+	for (uint64 i = 0; i < from; i++) { ++begin; }
+
+	auto linear = begin;
+	for (uint64 n = 0; n <= begin.count(); n++) {
+		auto jumped = begin;
+		jumped += n;
+		ASSERT_EQ(jumped.count(), linear.count());
+		ASSERT_EQ(jumped.has_next(), linear.has_next());
+		if (linear.has_next()) {
+			const auto a = *jumped;
+			const auto b = *linear;
+			const auto c = begin.peek(n);
+			ASSERT_EQ(std::memcmp(&a, &b, sizeof(a)), 0);
+			ASSERT_EQ(std::memcmp(&b, &c, sizeof(b)), 0);
+			++linear;
+		}
+	}
+}
+
+TEST(random_access, matches_linear) {
+	std::vector<int> v = {3, 1, 4, 1, 5, 9, 2, 6};
+	const auto       it = it::iterator(v.data(), v.size());
+	const auto       seq = it::sequence_generator(10, 17);
+	const array<int, 3> arr = {7, 8, 9};
+
+	for (uint64 from: {0, 1, 5}) {
+		expect_random_access_matches_linear(it, from);
+		expect_random_access_matches_linear(it::reverse(it), from);
+		expect_random_access_matches_linear(seq | it::reverse(), from);
+		expect_random_access_matches_linear(it | it::map([](int e) { return e * 2; }), from);
+		expect_random_access_matches_linear(it | it::zip(seq), from);
+		expect_random_access_matches_linear(it | it::take(6), from);
+		expect_random_access_matches_linear(it::append(it::take(seq, 3), seq), from);
+		expect_random_access_matches_linear(it::cross_product(it::take(it, 3), seq), from);
+		expect_random_access_matches_linear(it::unordered_pairs(it), from);
+		expect_random_access_matches_linear(it::unordered_pairs(seq), from);
+	}
+	expect_random_access_matches_linear(arr.to_iterator(), 1);
+	expect_random_access_matches_linear(it::single_element_iterator(42), 0);
+
+	ASSERT_EQ(it::take(it, 100).count(), v.size());
+	ASSERT_EQ(it | it::skip(100) | algo::count(), 0);
+	ASSERT_EQ(*(it::sequence_generator<uint64>(0, 1000000000) | it::skip(999999990)), 999999990);
+	ASSERT_EQ(it::unordered_pairs(seq) | it::skip(20) | algo::count(), 8);
+}
+
+template<it::SplittableIterator CI>
+void expect_split_matches(CI it) {
+	const auto elements = algo::to_array<std::vector<typename CI::value_type>>(it);
+	for (uint64 k = 0; k <= it.split_size(); k++) {
+		const auto [first, second] = it::split_at(it, k);
+		auto concatenated = algo::to_array<std::vector<typename CI::value_type>>(first);
+		const auto rest   = algo::to_array<std::vector<typename CI::value_type>>(second);
+		concatenated.insert(concatenated.end(), rest.begin(), rest.end());
+		ASSERT_EQ(concatenated.size(), elements.size());
+		ASSERT_EQ(std::memcmp(concatenated.data(), elements.data(), elements.size() * sizeof(elements[0])),
+				  0);
+	}
+}
+
+TEST(split, halves_concatenate) {
+	std::vector<int> v = {3, 1, 4, 1, 5, 9, 2, 6};
+	const auto       it = it::iterator(v.data(), v.size());
+	const auto       seq = it::sequence_generator(10, 17);
+
+	expect_split_matches(it);
+	expect_split_matches(it::reverse(it));
+	expect_split_matches(seq | it::map([](int e) { return e * 2; }));
+	expect_split_matches(it | it::filter([](int e) { return e % 2 == 1; }));
+	expect_split_matches(it | it::zip(seq));
+	expect_split_matches(it::cross_product(it, seq));
+	expect_split_matches(it::unordered_pairs(it));
+	expect_split_matches(it::unordered_pairs(it) | it::skip(5));
+
+	// A split by rows would put 3/4 of the pairs into the first half.
+	const auto pairs           = it::unordered_pairs(it::sequence_generator<uint64>(0, 1000));
+	const auto [first, second] = pairs | it::split_half();
+	ASSERT_EQ(first.count(), pairs.count() / 2);
+	ASSERT_EQ(second.count(), pairs.count() - pairs.count() / 2);
+	ASSERT_EQ(algo::count(first | it::filter([](auto) { return true; })), first.count());
+
+	const auto similar = pairs | it::filter([](auto p) { return (p.first ^ p.second) % 7 == 0; });
+	ASSERT_EQ(algo::parallel_count(similar, 4), algo::count(similar));
+}
+
+constexpr int constexpr_view_sum() {
+	array<int, 5> arr = {};
+	for (int i = 0; i < 5; i++) { arr[i] = i + 1; }
+	const auto [head, tail] = arr.head_tail();
+	int        sum          = head * 100;
+	for (auto view = tail.slice(1, 4); view.has_next(); ++view) { sum += *view; }
+	return sum;
+}
+
+TEST(array_view, zero_copy) {
+	const array<int, 6> arr = {3, 1, 4, 1, 5, 9};
+
+	const auto [head, tail] = arr.head_tail();
+	ASSERT_EQ(head, 3);
+	ASSERT_EQ(tail.count(), 5);
+	ASSERT_EQ(tail._data, arr.arr + 1);
+
+	const auto middle = arr.slice(1, 4);
+	ASSERT_EQ(algo::to_array<std::vector<int>>(middle), (std::vector<int>{1, 4, 1}));
+	ASSERT_EQ(middle.head_tail().tail.head_tail().head, 4);
+	ASSERT_EQ(algo::sum(arr.to_iterator()), 23);
+	ASSERT_EQ(algo::count(arr.slice(2, 2)), 0);
+	expect_split_matches(arr.to_iterator());
+
+	static_assert(it::RandomAccessIterator<array_view<int>>);
+	static_assert(it::BlockIterator<array_view<int>>);
+	static_assert(constexpr_view_sum() == 112);
+
+	// Copies only on request.
+	const array<int, 3> owned(arr.slice(3, 6));
+	ASSERT_EQ(owned, (array<int, 3>{1, 5, 9}));
+	ASSERT_EQ(algo::sum(owned.to_owning_iterator()), 15);
+	ASSERT_EQ(algo::count(array<int, 0>{}.to_iterator()), 0);
+}
+
+template<uint64 Bits, uint64 N, class Storage>
+void expect_packed_matches_scalar() {
+	using P          = packed_array<Bits, N, Storage>;
+	const uint64 mod = uint64(1) << Bits;
+
+	std::mt19937_64 random(Bits * 1000 + N);
+	for (int round = 0; round < 50; round++) {
+		P                   packed;
+		std::vector<uint64> values;
+		const uint64        size = random() % (N + 1);
+		for (uint64 i = 0; i < size; i++) {
+			const uint64 e = random() % mod;
+			packed         = typename P::value_type(e) + packed;
+			values.insert(values.begin(), e);
+		}
+		ASSERT_EQ(packed.size, size);
+		for (uint64 i = 0; i < size; i++) { ASSERT_EQ(packed[i], values[i]); }
+		ASSERT_EQ(algo::count(packed.to_iterator()), size);
+		std::vector<uint64> decoded;
+		for (auto e: packed.to_iterator()) { decoded.push_back(e); }
+		ASSERT_EQ(decoded, values);
+
+		const auto probe = typename P::value_type(random() % mod);
+		ASSERT_EQ(packed.count_equal(probe), uint64(std::count(values.begin(), values.end(), probe)));
+		ASSERT_EQ(packed.contains(probe), std::find(values.begin(), values.end(), probe) != values.end());
+
+		const P lanes(P::iota(probe), N);
+		const P sum(P::add(packed.arr, P::broadcast(probe)), N);
+		const P difference(P::sub(packed.arr, lanes.arr), N);
+		for (uint64 i = 0; i < size; i++) {
+			ASSERT_EQ(lanes[i], (probe + i) % mod);
+			ASSERT_EQ(sum[i], (values[i] + probe) % mod);
+			ASSERT_EQ(difference[i], (values[i] + mod - (probe + i) % mod) % mod);
+		}
+
+		if (size > 0) {
+			const auto [head, tail] = packed.head_tail();
+			ASSERT_EQ(head, values[0]);
+			ASSERT_EQ(tail.size, size - 1);
+			ASSERT_EQ(head + tail, packed);
+		}
+	}
+}
+
+TEST(packed_array, swar_matches_scalar) {
+	expect_packed_matches_scalar<1, 64, uint64>();
+	expect_packed_matches_scalar<3, 21, uint64>();
+	expect_packed_matches_scalar<4, 8, uint64>();
+	expect_packed_matches_scalar<7, 9, uint64>();
+	expect_packed_matches_scalar<16, 4, uint64>();
+	expect_packed_matches_scalar<12, 10, uint128>();
+	expect_packed_matches_scalar<16, 8, uint128>();
+
+	constexpr auto packed = uint8(3) + (uint8(2) + packed_array<4, 8>());
+	static_assert(packed[0] == 3 && packed[1] == 2 && packed.size == 2);
+	static_assert(packed.contains(2) && !packed.contains(0));
+	static_assert(sizeof(packed_array<4, 8>) == 16);
+}
+
+template<it::CustomIterator CI>
+std::vector<std::pair<int, int>> sorted_pairs(CI it) {
+	std::vector<std::pair<int, int>> result;
+	for (const auto p: algo::to_array<std::vector<typename CI::value_type>>(it)) {
+		result.emplace_back(p.first, p.second);
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+TEST(tiled_pairs, same_pairs_as_untiled) {
+	std::vector<int> v(37);
+	for (uint64 i = 0; i < v.size(); i++) { v[i] = int(i * 5 % 37); }
+	const auto it  = it::iterator(v.data(), v.size());
+	const auto seq = it::sequence_generator(100, 111);
+
+	for (uint64 tile: {0, 1, 3, 8, 37, 100}) {
+		const auto cross = it::cross_product_tiled(it, seq, tile);
+		ASSERT_EQ(cross.count(), it::cross_product(it, seq).count());
+		ASSERT_EQ(sorted_pairs(cross), sorted_pairs(it::cross_product(it, seq)));
+
+		const auto pairs = it | it::unordered_pairs_tiled(tile);
+		ASSERT_EQ(pairs.count(), it::unordered_pairs(it).count());
+		ASSERT_EQ(sorted_pairs(pairs), sorted_pairs(it::unordered_pairs(it)));
+
+		uint64 walked = 0;
+		for (auto walk = pairs; walk.has_next(); ++walk) {
+			ASSERT_EQ(walk.count(), pairs.count() - walked);
+			walked++;
+		}
+		ASSERT_EQ(walked, pairs.count());
+		ASSERT_EQ(algo::count(pairs | it::filter([](auto p) { return p.first > p.second; })),
+				  algo::count(it::unordered_pairs(it) | it::filter([](auto p) { return p.first > p.second; })));
+	}
+
+	const auto empty = it::iterator(v.data(), uint64(0));
+	ASSERT_FALSE(it::cross_product_tiled(empty, seq, 4).has_next());
+	ASSERT_FALSE(it::cross_product_tiled(seq, empty, 4).has_next());
+	ASSERT_FALSE(it::unordered_pairs_tiled(empty, 4).has_next());
+}
+
+TEST(arena, collect_into) {
+	std::vector<int> v(3000);
+	for (uint64 i = 0; i < v.size(); i++) { v[i] = int(i * 13 % 101); }
+	const auto it   = it::iterator(v.data(), v.size());
+	const auto even = [](int e) { return e % 2 == 0; };
+
+	alignas(16) uint8 buffer[1024];
+	arena             a(buffer, sizeof(buffer));
+
+	// Counting and contiguous, exactly one allocation that doesn't fit the buffer.
+	const auto copy = it | algo::collect_into(a);
+	ASSERT_EQ(copy.count(), v.size());
+	ASSERT_EQ(std::memcmp(copy._begin, v.data(), v.size() * sizeof(int)), 0);
+
+	// Unknown size, grows across chunks.
+	const auto evens    = it | it::filter(even) | algo::collect_into(a);
+	const auto expected = algo::to_array<std::vector<int>>(it | it::filter(even));
+	ASSERT_EQ(algo::to_array<std::vector<int>>(evens), expected);
+	ASSERT_EQ(algo::to_array<std::vector<int>>(it::sequence_generator(0, 1000) | algo::collect_into(a)),
+			  algo::to_array<std::vector<int>>(it::sequence_generator(0, 1000)));
+	ASSERT_EQ(algo::to_array<std::vector<int>>(it::reverse(it) | algo::collect_into(a)),
+			  algo::to_array<std::vector<int>>(it::reverse(it)));
+	ASSERT_FALSE(a.failed());
+
+	// Reset starts over in the buffer and reuses the chunks.
+	const auto *first_chunk = a._chunks;
+	a.reset();
+	const auto small = it | it::take(10) | algo::collect_into(a);
+	ASSERT_EQ(reinterpret_cast<const uint8 *>(small._begin), buffer);
+	const auto again = it | algo::collect_into(a);
+	ASSERT_EQ(reinterpret_cast<const uint8 *>(again._begin) - sizeof(arena::chunk),
+			  reinterpret_cast<const uint8 *>(first_chunk));
+
+	auto *aligned = static_cast<uint8 *>(a.allocate(1, 64));
+	ASSERT_EQ(reinterpret_cast<uint64>(aligned) % 64, 0);
+
+	// Without a grow function the arena is limited to its buffer.
+	arena      fixed(buffer, 100, nullptr, nullptr);
+	const auto truncated = it | it::filter(even) | algo::collect_into(fixed);
+	ASSERT_TRUE(fixed.failed());
+	ASSERT_LE(truncated.count() * sizeof(int), 100);
+	fixed.reset();
+	ASSERT_FALSE(fixed.failed());
+	ASSERT_EQ(algo::to_array<std::vector<int>>(it | it::take(25) | algo::collect_into(fixed)),
+			  algo::to_array<std::vector<int>>(it | it::take(25)));
+}
+
+TEST(mapped_file, records) {
+	struct record {
+		int64   key;
+		float64 value;
+	};
+	std::vector<record> records(5000);
+	for (uint64 i = 0; i < records.size(); i++) { records[i] = {int64(i * 7 % 1000), float64(i) / 2}; }
+
+	char path[] = "/tmp/d_iterator_mapped_XXXXXX";
+	const int fd = mkstemp(path);
+	ASSERT_GE(fd, 0);
+	std::FILE *file = fdopen(fd, "wb");
+	ASSERT_EQ(std::fwrite(records.data(), sizeof(record), records.size(), file), records.size());
+	ASSERT_EQ(std::fwrite("abc", 1, 3, file), 3); // a partial record is ignored
+	std::fclose(file);
+
+	{
+		const it::mapped_file<record> mapped(path);
+		ASSERT_EQ(mapped.error(), 0);
+		ASSERT_EQ(mapped.count(), records.size());
+
+		const auto it = mapped.to_iterator();
+		ASSERT_EQ(algo::count(it), records.size());
+		ASSERT_EQ(it.peek(4321).key, records[4321].key);
+		ASSERT_EQ(it | it::map([](record r) { return r.key; }) | algo::sum<int64>(),
+				  algo::sum<int64>(it::iterator(records.data(), records.size())
+								   | it::map([](record r) { return r.key; })));
+		ASSERT_EQ(algo::count(it | it::filter([](record r) { return r.key == 0; })), 5);
+		ASSERT_EQ(algo::parallel_count(it | it::filter([](record r) { return r.value > 100; }), 3),
+				  records.size() - 201);
+
+		it::mapped_file<int64> keys(path, {.pattern = it::AccessPattern::Random, .populate = true});
+		ASSERT_EQ(keys.count(), (records.size() * sizeof(record) + 3) / sizeof(int64));
+		const it::mapped_file<int64> moved = std::move(keys);
+		ASSERT_EQ(keys.count(), 0);
+		ASSERT_EQ(moved.to_iterator().peek(2), records[1].key);
+	}
+
+	std::fclose(std::fopen(path, "wb"));
+	const it::mapped_file<record> empty(path);
+	ASSERT_EQ(empty.error(), 0);
+	ASSERT_FALSE(empty.to_iterator().has_next());
+	std::remove(path);
+
+	const it::mapped_file<record> missing(path);
+	ASSERT_NE(missing.error(), 0);
+	ASSERT_EQ(algo::count(missing.to_iterator()), 0);
+}
+
+TEST(fd_reader, records) {
+	struct record {
+		int32 key;
+		int32 value;
+		int32 tag;
+	};
+	std::vector<record> records(5000);
+	for (uint64 i = 0; i < records.size(); i++) { records[i] = {int32(i * 7 % 1000), int32(i), 3}; }
+	const int64 expected = algo::sum<int64>(it::iterator(records.data(), records.size())
+											| it::map([](record r) { return r.key; }));
+
+	char path[] = "/tmp/d_iterator_fd_XXXXXX";
+	const int fd = mkstemp(path);
+	ASSERT_GE(fd, 0);
+	std::FILE *file = fdopen(fd, "wb");
+	ASSERT_EQ(std::fwrite(records.data(), sizeof(record), records.size(), file), records.size());
+	ASSERT_EQ(std::fwrite("abc", 1, 3, file), 3); // a partial record is ignored
+	std::fclose(file);
+
+	// Copies share the position, so the adapters that traverse a copy reject the iterators.
+	using fd_iterator = it::fd_reader<record>::iterator;
+	static_assert(it::BlockIterator<fd_iterator> && !it::CopyableIterator<fd_iterator>);
+	static_assert(!it::CopyableIterator<decltype(std::declval<fd_iterator>() | it::map([](record r) { return r.key; }))>);
+
+	for (const bool read_ahead: {false, true}) {
+		// The buffers are rounded down to 96 bytes, so there are 8 records per read.
+		it::fd_reader<record> reader(path, {.buffer_bytes = 100, .read_ahead = read_ahead});
+		ASSERT_EQ(reader.error(), 0);
+		ASSERT_EQ(reader.to_iterator() | it::map([](record r) { return r.key; }) | algo::sum<int64>(),
+				  expected);
+		ASSERT_FALSE(reader.to_iterator().has_next());
+
+		it::fd_reader<record> counted(path, {.buffer_bytes = 4096, .read_ahead = read_ahead});
+		ASSERT_EQ(algo::count(counted.to_iterator() | it::filter([](record r) { return r.key == 0; })), 5);
+
+		// The filter holds a block of the reader while it moves on to the next buffer.
+		it::fd_reader<record> filtered(path, {.buffer_bytes = 100, .read_ahead = read_ahead});
+		const auto kept = algo::to_array<std::vector<record>>(filtered.to_iterator()
+															  | it::filter([](record r) { return r.value % 3 != 0; }));
+		ASSERT_EQ(kept.size(), 3333);
+		bool equal = true;
+		for (uint64 i = 0; i < kept.size(); i++) { equal = equal && kept[i].value == int32(i / 2 * 3 + i % 2 + 1); }
+		ASSERT_TRUE(equal);
+	}
+
+	// The writer splits records, so they straddle the reads.
+	for (const bool read_ahead: {false, true}) {
+		int pipe_fds[2];
+		ASSERT_EQ(pipe(pipe_fds), 0);
+		std::thread writer([&]() {
+			const auto *bytes = reinterpret_cast<const char *>(records.data());
+			for (uint64 done = 0, piece = 1; done < records.size() * sizeof(record); piece = piece * 7 % 1013) {
+				const auto written = write(pipe_fds[1], bytes + done,
+										   it::min(piece, records.size() * sizeof(record) - done));
+				if (written > 0) { done += uint64(written); }
+			}
+			close(pipe_fds[1]);
+		});
+		{
+			it::fd_reader<record> reader(pipe_fds[0], {.buffer_bytes = 256, .read_ahead = read_ahead});
+			uint64 i     = 0;
+			bool   equal = true;
+			for (auto it = reader.to_iterator(); it.has_next(); ++it, i++) {
+				equal = equal && (*it).key == records[i].key && (*it).value == records[i].value;
+			}
+			ASSERT_TRUE(equal);
+			ASSERT_EQ(i, records.size());
+		}
+		writer.join();
+		close(pipe_fds[0]);
+	}
+	std::remove(path);
+
+	it::fd_reader<record> missing(path);
+	ASSERT_NE(missing.error(), 0);
+	ASSERT_EQ(algo::count(missing.to_iterator()), 0);
+}
+
+TEST(counted_wrapper, modes) {
+	std::vector<int> v;
+	for (int i = 0; i < 1000; i++) { v.push_back(i); }
+	const auto odd = it::iterator(v.data(), v.size()) | it::filter([](int e) { return e % 2 == 1; });
+
+	auto recount = odd | it::counted_wrapper<it::CountMode::Recount>();
+	auto eager   = odd | it::counted_wrapper<it::CountMode::Eager>();
+	auto lazy    = odd | it::counted_wrapper();
+	static_assert(it::CountingIterator<decltype(lazy)>);
+
+	// The lazy mode doesn't traverse the source before the first count().
+	uint64     calls  = 0;
+	const auto probed = it::iterator(v.data(), v.size()) | it::filter([&calls](int e) {
+							calls++;
+							return e % 2 == 1;
+						});
+	const uint64 before  = calls;
+	const auto   waiting = probed | it::counted_wrapper();
+	ASSERT_EQ(calls, before);
+	ASSERT_EQ(waiting.count(), 500);
+	ASSERT_GT(calls, before);
+	calls = 0;
+	ASSERT_EQ((probed | it::counted_wrapper<it::CountMode::Eager>()).count(), 500);
+	ASSERT_GT(calls, 0);
+
+	for (uint64 left = 500; left > 0; left--) {
+		ASSERT_EQ(recount.count(), left);
+		ASSERT_EQ(eager.count(), left);
+		ASSERT_EQ(lazy.count(), left);
+		ASSERT_EQ(*lazy, *eager);
+		++recount;
+		++eager;
+		++lazy;
+	}
+	ASSERT_EQ(lazy.count(), 0);
+
+	const auto vec = algo::to_array<std::vector<int>>(odd | it::counted_wrapper());
+	ASSERT_EQ(vec.size(), 500);
+	ASSERT_EQ(vec.capacity(), 500);
+	ASSERT_EQ(vec[499], 999);
+}
+
+TEST(c_string_iterator, word_at_a_time) {
+	std::string text;
+	for (int i = 0; i < 300; i++) { text.push_back(char('a' + i % 26)); }
+
+	// Every length and alignment, each string in its own allocation to let the sanitizer see overreads.
+	for (uint64 offset = 0; offset < 9; offset++) {
+		for (uint64 len = 0; len < 100; len++) {
+			std::vector<char> storage(offset + len + 1, '\0');
+			std::memcpy(storage.data() + offset, text.data(), len);
+			const char *str = storage.data() + offset;
+
+			const auto it = it::c_string_iterator(str);
+			ASSERT_EQ(algo::count(it), len);
+			ASSERT_EQ(algo::find(it, 'k'), std::strchr(str, 'k') ? uint64(std::strchr(str, 'k') - str) : len);
+			ASSERT_EQ(it | algo::find('#'), len);
+
+			const auto copy = algo::to_array<std::vector<char>>(it);
+			ASSERT_EQ(std::string(copy.begin(), copy.end()), std::string(str));
+		}
+	}
+
+	// A zero byte in front of the string must not turn the following 0x01 into a false terminator.
+	const char bytes[] = {'\0', '\0', '\0', '\x01', '\x02', '\x80', '\x01', '\0'};
+	ASSERT_EQ(algo::count(it::c_string_iterator(bytes + 3)), 4);
+	ASSERT_EQ(algo::find(it::c_string_iterator(bytes + 3), '\x80'), 2);
+	static_assert(simd::strlen("constexpr") == 9);
+}
+
+static std::vector<std::string> split_reference(const std::string &text, char delimiter) {
+	std::vector<std::string> fields;
+	for (uint64 pos = 0; !text.empty();) {
+		const uint64 next = text.find(delimiter, pos);
+		fields.push_back(text.substr(pos, next == std::string::npos ? next : next - pos));
+		if (next == std::string::npos) { break; }
+		pos = next + 1;
+	}
+	return fields;
+}
+
+constexpr uint64 constexpr_line_count() {
+	return it::split_lines(it::c_string_iterator("first\nsecond\n\nfourth\n")) | algo::count();
+}
+
+TEST(text_split, fields_and_lines) {
+	std::string log;
+	for (int i = 0; i < 2000; i++) { log += std::string(i * 37 % 150, char('a' + i % 26)) + (i % 3 ? '\n' : ','); }
+
+	// Every start within a 64 byte window and ends with and without a trailing delimiter.
+	for (uint64 offset = 0; offset < 65; offset += 13) {
+		for (const std::string &tail: {std::string(), std::string("tail")}) {
+			const std::string text   = log.substr(offset) + tail;
+			const auto        source = array_view<char>(text.data(), text.size());
+
+			for (const char delimiter: {',', '\n'}) {
+				const auto expected = split_reference(text, delimiter);
+				auto       fields   = source | it::split(delimiter);
+				ASSERT_EQ(fields.count(), expected.size());
+				std::vector<std::string> actual;
+				for (const auto field: fields) { actual.emplace_back(field.data(), field.count()); }
+				ASSERT_EQ(actual, expected);
+			}
+
+			auto expected = split_reference(text, '\n');
+			if (text.back() == '\n') { expected.pop_back(); }
+			auto lines = it::split_lines(source);
+			ASSERT_EQ(lines.count(), expected.size());
+			for (uint64 i = 0; i < expected.size(); i++, ++lines) {
+				if (i % 100 == 0) { ASSERT_EQ(lines.count(), expected.size() - i); }
+				ASSERT_EQ(std::string((*lines).data(), (*lines).count()), expected[i]);
+			}
+			ASSERT_FALSE(lines.has_next());
+			ASSERT_EQ(lines.count(), 0);
+		}
+	}
+
+	ASSERT_EQ(algo::count(it::split("", 0, ',')), 0);
+	ASSERT_EQ(algo::count(it::split(",", 1, ',')), 2);
+	ASSERT_EQ(algo::count(it::split_lines("\n", 1)), 1);
+	ASSERT_EQ(it::split_lines(it::c_string_iterator("a\nbb\nccc"))
+					  | it::map([](array_view<char> line) { return line.count(); }) | algo::sum<uint64>(),
+			  6);
+	static_assert(constexpr_line_count() == 4);
+	ASSERT_EQ(simd::find_byte(log.data(), log.size(), ','), log.find(','));
+	ASSERT_EQ(simd::count_byte(log.data(), log.size(), '\n'), uint64(std::count(log.begin(), log.end(), '\n')));
+}
+
+TEST(any_iterator, runtime_composition) {
+	std::vector<int> v;
+	for (int i = 0; i < 1000; i++) { v.push_back(i); }
+	const auto source = it::iterator(v.data(), v.size());
+
+	for (const int query: {0, 1, 2}) {
+		it::any_iterator<int> pipeline = source;
+		if (query == 1) { pipeline = source | it::filter([](int e) { return e % 3 == 0; }); }
+		if (query == 2) { pipeline = source | it::map([](int e) { return e * 2; }) | it::take(10); }
+
+		int64 expected = 0;
+		if (query == 0) { expected = 999 * 1000 / 2; }
+		if (query == 1) { expected = 3 * 333 * 334 / 2; }
+		if (query == 2) { expected = 90; }
+
+		ASSERT_EQ(algo::sum<int64>(pipeline), expected);
+
+		int64 element_wise = 0;
+		for (auto e: pipeline) { element_wise += e; }
+		ASSERT_EQ(element_wise, expected);
+	}
+
+	// The stages can be stacked, as long as every level has a larger buffer.
+	it::any_iterator<int, 32>  inner = source | it::filter([](int e) { return e < 100; });
+	it::any_iterator<int, 128> outer = inner | it::filter([](int e) { return e % 2 == 0; });
+	ASSERT_EQ(algo::count(outer), 50);
+	ASSERT_EQ(algo::to_array<std::vector<int>>(outer).back(), 98);
+
+	static_assert(!std::is_constructible_v<it::any_iterator<int, 8>, decltype(source)>);
+	static_assert(it::TriviallyCopyable<it::any_iterator<int>>);
+}
+
+TEST(parallel, matches_serial) {
+	std::vector<int> v;
+	for (int i = 0; i < 100000; i++) { v.push_back(i % 1000); }
+
+	const auto it = it::iterator(v.data(), v.size());
+	static_assert(it::SplittableIterator<decltype(it | it::filter([](int) { return true; }))>);
+
+	// Only the first percent passes, so all work ends up in the chunks of the first worker.
+	const auto skewed = it::sequence_generator<uint64>(0, v.size())
+					  | it::filter([](uint64 i) { return i < 1000 || i % 7 == 0; })
+					  | it::map([&v](uint64 i) { return int64(v[i]); });
+	const auto matches = it | it::filter([](int e) { return e % 3 == 0; });
+
+	for (const uint64 threads: {1, 2, 3, 8}) {
+		ASSERT_EQ(algo::parallel_count(it, threads), v.size());
+		ASSERT_EQ(algo::parallel_count(matches, threads), algo::count(matches));
+		ASSERT_EQ(algo::parallel_sum(skewed, threads), algo::sum(skewed));
+		ASSERT_EQ(it | algo::parallel_sum<int64>(threads), algo::sum<int64>(it));
+		ASSERT_EQ(algo::parallel_sum<int64>(it::reverse(it), threads), algo::sum<int64>(it));
+
+		const auto max = algo::parallel_reduce(
+				it, [](int a, int b) { return it::max(a, b); }, 0,
+				[](int a, int b) { return it::max(a, b); }, threads);
+		ASSERT_EQ(max, 999);
+
+		// Not commutative: the ranges only join if they are combined in source order.
+		using range     = std::pair<int64, int64>;
+		const auto join = [](range a, range b) {
+			if (a.first < 0) { return b; }
+			if (b.first < 0) { return a; }
+			return a.second + 1 == b.first ? range{a.first, b.second} : range{-2, -2};
+		};
+		const auto ordered = algo::parallel_reduce(
+				it::sequence_generator<int64>(0, 100000) | it::map([](int64 e) { return range{e, e}; }),
+				join, range{-1, -1}, join, threads);
+		ASSERT_EQ(ordered, range(0, 99999));
+
+		ASSERT_TRUE(it | it::map([](int e) { return e == 999; }) | algo::parallel_any(threads));
+		ASSERT_FALSE(it | it::map([](int e) { return e < 0; }) | algo::parallel_any(threads));
+
+		const auto empty = it::iterator(v.data(), uint64(0));
+		ASSERT_EQ(algo::parallel_count(empty, threads), 0);
+		ASSERT_EQ(algo::parallel_sum(it::reverse(it::sequence_generator(0, 100)), threads), 4950);
+	}
+}
+
+constexpr int constexpr_top_k() {
+	int        values[] = {5, 1, 9, 3, 7, 9, 2};
+	const auto top      = algo::top_k<3>(it::iterator(values, 7));
+	return top[0] * 100 + top[1] * 10 + top[2];
+}
+
+TEST(top_k, matches_sort) {
+	std::vector<int64> v(100000);
+	std::mt19937_64    rng(7);
+	for (auto &e: v) { e = int64(rng() % 50000); } // with duplicates
+	const auto source = it::iterator(v.data(), v.size());
+
+	auto sorted = v;
+	std::sort(sorted.begin(), sorted.end(), std::greater<>());
+	const auto expect_prefix = [](const auto &top, const std::vector<int64> &expected, uint64 k) {
+		ASSERT_EQ(top.count(), k);
+		ASSERT_EQ(algo::to_array<std::vector<int64>>(top.to_iterator()),
+				  std::vector<int64>(expected.begin(), expected.begin() + int64(k)));
+	};
+
+	expect_prefix(source | algo::top_k<100>(), sorted, 100);
+	expect_prefix(algo::top_k<1>(source), sorted, 1);
+	for (const uint64 threads: {1, 3, 8}) {
+		expect_prefix(algo::parallel_top_k<100>(source, algo::_i_less(), threads), sorted, 100);
+	}
+
+	// Element by element through a filter, and fewer elements than k.
+	const auto even = [](int64 e) { return e % 2 == 0; };
+	std::vector<int64> evens;
+	std::copy_if(sorted.begin(), sorted.end(), std::back_inserter(evens), even);
+	auto stepped = algo::top_k<50>(it::sequence_generator<uint64>(0, v.size())
+								   | it::map([&v](uint64 i) { return v[i]; }) | it::filter(even));
+	expect_prefix(stepped, evens, 50);
+	expect_prefix(algo::top_k<100>(it::iterator(sorted.data() + 99990, 10)),
+				  {sorted.begin() + 99990, sorted.end()}, 10);
+
+	// The comparison decides what largest means, here the smallest.
+	const auto smallest = source | algo::top_k<20>([](int64 a, int64 b) { return a > b; });
+	std::sort(sorted.begin(), sorted.end());
+	expect_prefix(smallest, sorted, 20);
+
+	ASSERT_EQ(algo::top_k<5>(it::iterator(v.data(), uint64(0))).count(), 0);
+	static_assert(constexpr_top_k() == 997);
+}
+
+TEST(group_by, matches_map) {
+	std::vector<int64> v(100000);
+	std::mt19937_64    rng(11);
+	for (auto &e: v) { e = int64(rng() % 1000000); }
+	const auto source = it::iterator(v.data(), v.size());
+	const auto key    = [](int64 e) { return e % 5003; };
+	const auto plus   = [](int64 a, int64 b) { return a + b; };
+	const auto sum    = algo::aggregate(int64(0), plus, plus);
+	const auto add    = [](uint64 a, uint64 b) { return a + b; };
+	const auto count  = algo::aggregate(uint64(0), [](uint64 acc, int64) { return acc + 1; }, add);
+
+	std::map<int64, int64>  sums;
+	std::map<int64, uint64> counts;
+	std::vector<int64>      first_seen;
+	for (const auto e: v) {
+		if (counts[key(e)]++ == 0) { first_seen.push_back(key(e)); }
+		sums[key(e)] += e;
+	}
+	const auto as_map = [](auto groups) {
+		std::map<int64, decltype(groups[0].value)> result;
+		for (const auto &g: groups) { result[g.key] = g.value; }
+		EXPECT_EQ(result.size(), groups.count()); // every key once
+		return result;
+	};
+
+	arena      a;
+	const auto grouped = source | algo::group_by(key, sum, a);
+	ASSERT_EQ(as_map(grouped), sums);
+	std::vector<int64> order;
+	for (const auto &g: grouped) { order.push_back(g.key); }
+	ASSERT_EQ(order, first_seen);
+	ASSERT_EQ(as_map(algo::group_by(source, key, count, a)), counts);
+	for (const uint64 threads: {1, 3, 8}) {
+		ASSERT_EQ(as_map(algo::parallel_group_by(source, key, sum, a, threads)), sums);
+		ASSERT_EQ(as_map(source | algo::parallel_group_by(key, count, a, threads)), counts);
+	}
+	ASSERT_FALSE(a.failed());
+
+	// Element by element, the table grows from its smallest size.
+	const auto odd = [](int64 e) { return e % 2 != 0; };
+	std::map<int64, uint64> odd_counts;
+	for (const auto e: v) {
+		if (odd(e)) { odd_counts[e % 7]++; }
+	}
+	const auto stepped = it::sequence_generator<uint64>(0, v.size()) | it::map([&v](uint64 i) { return v[i]; })
+						 | it::filter(odd) | algo::group_by([](int64 e) { return e % 7; }, count, a);
+	ASSERT_EQ(as_map(stepped), odd_counts);
+
+	// Fields of text are keys, they point into the text.
+	char       text[] = "b,a,c,a,b,a,,c";
+	const auto tally  = algo::aggregate(uint64(0), [](uint64 acc, array_view<char>) { return acc + 1; });
+	const auto words  = it::split(text, sizeof(text) - 1, ',')
+					   | algo::group_by([](array_view<char> w) { return w; }, tally, a);
+	std::map<std::string, uint64> word_counts;
+	for (const auto &g: words) { word_counts[std::string(g.key.data(), g.key.count())] = g.value; }
+	ASSERT_EQ(word_counts, (std::map<std::string, uint64>{{"", 1}, {"a", 3}, {"b", 2}, {"c", 2}}));
+
+	// Lookups, and a table that runs out of memory keeps what it has.
+	algo::flat_table<int64, int64> table(a);
+	for (int64 k = 0; k < 1000; k++) { table.insert(k * 1024, k); }
+	ASSERT_EQ(table.count(), 1000);
+	ASSERT_EQ(table.find(5 * 1024)->value, 5);
+	ASSERT_EQ(table.find(5), nullptr);
+
+	alignas(16) uint8 buffer[4096];
+	arena             fixed(buffer, sizeof(buffer), nullptr, nullptr);
+	const auto        truncated = source | algo::group_by(key, sum, fixed);
+	ASSERT_TRUE(fixed.failed());
+	ASSERT_GT(truncated.count(), 0);
+	ASSERT_LT(truncated.count(), sums.size());
+
+	// The worker arenas grow like the arena of the result, a worker that runs out sets its failed().
+	static std::atomic<bool> grant;
+	const auto limited = [](uint64 bytes) { return grant.load() ? std::malloc(bytes) : nullptr; };
+	std::vector<uint8>       roomy(1 << 20);
+	for (const uint64 threads: {3, 8}) {
+		grant = false;
+		arena workers_fail(roomy.data(), roomy.size(), limited, arena::default_release);
+		source | algo::parallel_group_by(key, sum, workers_fail, threads);
+		ASSERT_TRUE(workers_fail.failed());
+
+		grant = true;
+		arena unlimited(roomy.data(), roomy.size(), limited, arena::default_release);
+		ASSERT_EQ(as_map(source | algo::parallel_group_by(key, sum, unlimited, threads)), sums);
+		ASSERT_FALSE(unlimited.failed());
+	}
+}
+
+struct join_row {
+	int64 id;
+	int64 payload;
+};
+
+TEST(join, matches_nested_loops) {
+	std::mt19937_64       rng(5);
+	std::vector<join_row> rows(3000);
+	for (uint64 i = 0; i < rows.size(); i++) { rows[i] = {int64(rng() % 2000), int64(i)}; } // duplicate ids
+	std::vector<int64> events(20000);
+	for (auto &e: events) { e = int64(rng() % 4000); } // about 40% have a row
+	const auto build  = it::iterator(rows.data(), rows.size());
+	const auto probe  = it::iterator(events.data(), events.size());
+	const auto row_id = [](join_row r) { return r.id; };
+	const auto self   = [](int64 e) { return e; };
+
+	std::vector<std::pair<int64, int64>> expected; // payload, event in probe order
+	std::set<int64>                      ids;
+	for (const auto e: events) {
+		for (const auto &r: rows) {
+			if (r.id == e) { expected.emplace_back(r.payload, e); }
+		}
+	}
+	for (const auto &r: rows) { ids.insert(r.id); }
+	const auto as_pairs = [](auto joined) {
+		std::vector<std::pair<int64, int64>> result;
+		for (const auto j: joined) { result.emplace_back(j.build.payload, j.probe); }
+		return result;
+	};
+
+	arena      a;
+	const auto joined = it::hash_join(build, probe, row_id, self, a);
+	ASSERT_EQ(as_pairs(joined), expected);
+	ASSERT_EQ(algo::count(probe | it::hash_join(build, row_id, self, a)), expected.size());
+	for (const uint64 threads: {1, 3}) { ASSERT_EQ(algo::parallel_count(joined, threads), expected.size()); }
+
+	// Blocks through a pipeline, smaller than the matches of one key.
+	std::vector<std::pair<int64, int64>> blocked;
+	auto                                 rest = joined;
+	it::join_pair<join_row, int64>       buffer[7];
+	for (auto b = rest.next_block(buffer, 7); b.size != 0; b = rest.next_block(buffer, 7)) {
+		for (uint64 i = 0; i < b.size; i++) { blocked.emplace_back(b.data[i].build.payload, b.data[i].probe); }
+	}
+	ASSERT_EQ(blocked, expected);
+
+	std::vector<int64> with, without;
+	for (const auto e: events) { (ids.count(e) != 0 ? with : without).push_back(e); }
+	const auto semi = probe | it::semi_join(build, row_id, self, a);
+	const auto anti = it::anti_join(build, probe, row_id, self, a);
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(semi), with);
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(anti), without);
+	ASSERT_EQ(algo::sum<int64>(semi), std::accumulate(with.begin(), with.end(), int64(0)));
+	ASSERT_EQ(algo::parallel_count(anti, 3), without.size());
+
+	// Element by element on the probe side, and empty sides.
+	const auto odd_events = it::sequence_generator<uint64>(0, events.size())
+							| it::map([&events](uint64 i) { return events[i]; })
+							| it::filter([](int64 e) { return e % 2 != 0; });
+	std::vector<int64> odd_with;
+	std::copy_if(with.begin(), with.end(), std::back_inserter(odd_with), [](int64 e) { return e % 2 != 0; });
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(odd_events | it::semi_join(build, row_id, self, a)), odd_with);
+	ASSERT_FALSE((probe | it::hash_join(it::iterator(rows.data(), uint64(0)), row_id, self, a)).has_next());
+	ASSERT_EQ(algo::count(it::iterator(events.data(), uint64(0)) | it::anti_join(build, row_id, self, a)), 0);
+	ASSERT_FALSE(a.failed());
+
+	// A build side that doesn't fit matches nothing.
+	alignas(16) uint8 small[256];
+	arena             fixed(small, sizeof(small), nullptr, nullptr);
+	ASSERT_EQ(algo::count(probe | it::hash_join(build, row_id, self, fixed)), 0);
+	ASSERT_TRUE(fixed.failed());
+}
+
+TEST(merge, matches_sort) {
+	std::mt19937_64                 rng(6);
+	std::vector<std::vector<int64>> shards(37);
+	std::vector<int64>              all;
+	for (auto &shard: shards) {
+		shard.resize(rng() % 300); // some are empty
+		for (auto &e: shard) { e = int64(rng() % 500); }
+		std::sort(shard.begin(), shard.end());
+		all.insert(all.end(), shard.begin(), shard.end());
+	}
+	std::sort(all.begin(), all.end());
+	const auto shard = [&shards](uint64 i) { return it::iterator(shards[i].data(), shards[i].size()); };
+
+	// Two-way, stable: the first element of a pair is the key, the second one the input.
+	std::vector<std::pair<int64, int64>> a_1, a_2, merged;
+	for (const auto e: shards[0]) { a_1.emplace_back(e, 1); }
+	for (const auto e: shards[1]) { a_2.emplace_back(e, 2); }
+	std::merge(a_1.begin(), a_1.end(), a_2.begin(), a_2.end(), std::back_inserter(merged),
+			   [](auto x, auto y) { return x.first < y.first; });
+	const auto by_key = [](std::pair<int64, int64> x, std::pair<int64, int64> y) { return x.first < y.first; };
+	const auto two
+			= it::iterator(a_1.data(), a_1.size()) | it::merge(it::iterator(a_2.data(), a_2.size()), by_key);
+	std::vector<std::pair<int64, int64>> merged_two;
+	for (const auto &e: two) { merged_two.push_back(e); }
+	ASSERT_EQ(merged_two, merged);
+	ASSERT_EQ(two.count(), merged.size());
+
+	// The branch-free blocks of contiguous inputs, in blocks smaller than the inputs.
+	std::vector<int64> expected_2;
+	std::merge(shards[2].begin(), shards[2].end(), shards[3].begin(), shards[3].end(),
+			   std::back_inserter(expected_2));
+	std::vector<int64> blocked;
+	auto               rest = it::merge(shard(2), shard(3));
+	int64              buffer[7];
+	for (auto b = rest.next_block(buffer, 7); b.size != 0; b = rest.next_block(buffer, 7)) {
+		blocked.insert(blocked.end(), b.data, b.data + b.size);
+	}
+	ASSERT_EQ(blocked, expected_2);
+	ASSERT_EQ(algo::sum<int64>(it::merge(shard(2), shard(3))),
+			  std::accumulate(expected_2.begin(), expected_2.end(), int64(0)));
+	const auto empty = it::iterator(shards[3].data(), uint64(0));
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(it::merge(shard(2), empty)), shards[2]);
+	std::vector<int64> none;
+	const auto         null = it::iterator(none.data(), uint64(0)); // no data at all
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(it::merge(null, shard(2))), shards[2]);
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(it::merge(shard(2), null)), shards[2]);
+
+	// Not contiguous and a different order.
+	const auto evens = it::sequence_generator<int64>(0, 100) | it::filter([](int64 e) { return e % 2 == 0; });
+	const auto odds  = it::sequence_generator<int64>(0, 100) | it::filter([](int64 e) { return e % 2 != 0; });
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(it::merge(evens, odds)),
+			  algo::to_array<std::vector<int64>>(it::sequence_generator<int64>(0, 100)));
+
+	std::vector<int64> first_five;
+	for (uint64 i = 0; i < 5; i++) { first_five.insert(first_five.end(), shards[i].begin(), shards[i].end()); }
+	std::sort(first_five.begin(), first_five.end());
+	const auto five = it::merge_k(shard(0), shard(1), shard(2), shard(3), shard(4));
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(five), first_five);
+	std::vector<int64> descending(first_five.rbegin(), first_five.rend());
+	std::vector<std::vector<int64>> reversed(5);
+	for (uint64 i = 0; i < 5; i++) { reversed[i].assign(shards[i].rbegin(), shards[i].rend()); }
+	const auto r = [&reversed](uint64 i) { return it::iterator(reversed[i].data(), reversed[i].size()); };
+	const auto five_descending = it::merge_k(std::greater<>(), r(0), r(1), r(2), r(3), r(4));
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(five_descending), descending);
+
+	// Loser tree over all shards, a single one and none.
+	std::vector<it::iterator<int64>> iterators;
+	for (uint64 i = 0; i < shards.size(); i++) { iterators.push_back(shard(i)); }
+	arena      a;
+	const auto loser_tree = it::merge_k(array_view(iterators.data(), iterators.size()), a);
+	ASSERT_EQ(loser_tree.count(), all.size());
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(loser_tree), all);
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(it::merge_k(array_view(iterators.data(), 1), a)), shards[0]);
+	ASSERT_FALSE(it::merge_k(array_view(iterators.data(), 0), a).has_next());
+	ASSERT_FALSE(a.failed());
+
+	// Equal keys on both sides yield every pair.
+	std::vector<std::pair<int64, int64>> joined, nested;
+	for (const auto x: shards[5]) {
+		for (const auto y: shards[6]) {
+			if (x == y) { nested.emplace_back(x, y); }
+		}
+	}
+	const auto self = [](int64 e) { return e; };
+	for (const auto p: shard(5) | it::merge_join(shard(6), self, self)) {
+		joined.emplace_back(p.first, p.second);
+	}
+	ASSERT_EQ(joined, nested);
+	std::vector<int64> keys = {1, 1, 2, 4, 4, 4, 7};
+	std::vector<int64> more = {0, 1, 1, 4, 4, 7, 7, 9};
+	const auto keys_it = it::iterator(keys.data(), keys.size());
+	ASSERT_EQ(algo::count(keys_it | it::merge_join(it::iterator(more.data(), more.size()), self, self)), 4 + 6 + 2);
+	ASSERT_FALSE(it::merge_join(keys_it, it::iterator(more.data(), uint64(0)), self, self).has_next());
+}
+
+TEST(window, matches_recomputation) {
+	constexpr uint64   w = 7;
+	std::mt19937_64    rng(7);
+	std::vector<int64> series(1000);
+	for (auto &e: series) { e = int64(rng() % 100) - 50; }
+	std::vector<std::vector<int64>> windows;
+	std::vector<int64>              sums, mins, maxs;
+	std::vector<double>             means;
+	for (uint64 i = 0; i + w <= series.size(); i++) {
+		windows.emplace_back(series.begin() + int64(i), series.begin() + int64(i + w));
+		sums.push_back(std::accumulate(windows.back().begin(), windows.back().end(), int64(0)));
+		means.push_back(double(sums.back()) / double(w));
+		mins.push_back(*std::min_element(windows.back().begin(), windows.back().end()));
+		maxs.push_back(*std::max_element(windows.back().begin(), windows.back().end()));
+	}
+	const auto source = it::iterator(series.data(), series.size());
+
+	std::vector<std::vector<int64>> viewed;
+	for (const auto view: source | it::window<w>()) {
+		viewed.emplace_back(view._data, view._data + view.count());
+	}
+	ASSERT_EQ(viewed, windows);
+	ASSERT_EQ((source | it::window<w>()).count(), windows.size());
+
+	const auto rolling_sums = source | it::rolling<w>(it::rolling_sum());
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(rolling_sums), sums);
+	ASSERT_EQ(rolling_sums.count(), sums.size());
+	ASSERT_EQ(algo::to_array<std::vector<double>>(source | it::rolling<w>(it::rolling_mean())), means);
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(source | it::rolling<w>(it::rolling_min())), mins);
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(source | it::rolling<w>(it::rolling_max())), maxs);
+
+	// The block path in blocks smaller and larger than the window, and a source without count.
+	std::vector<int64> blocked;
+	auto               rest = source | it::rolling<w>(it::rolling_min());
+	int64              buffer[5];
+	for (auto b = rest.next_block(buffer, 5); b.size != 0; b = rest.next_block(buffer, 5)) {
+		blocked.insert(blocked.end(), b.data, b.data + b.size);
+	}
+	ASSERT_EQ(blocked, mins);
+	ASSERT_EQ(algo::sum<int64>(source | it::rolling<w>(it::rolling_max())),
+			  std::accumulate(maxs.begin(), maxs.end(), int64(0)));
+	const auto all = it::sequence_generator<uint64>(0, series.size()) | it::filter([](uint64) { return true; })
+				   | it::map([&series](uint64 i) { return series[i]; });
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(all | it::rolling<w>(it::rolling_sum())), sums);
+
+	// Shorter than the window, exactly one window.
+	ASSERT_FALSE((it::iterator(series.data(), w - 1) | it::rolling<w>(it::rolling_sum())).has_next());
+	ASSERT_EQ((it::iterator(series.data(), w - 1) | it::window<w>()).count(), 0);
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(it::iterator(series.data(), w) | it::rolling<w>(it::rolling_max())),
+			  std::vector<int64>{maxs[0]});
+}
+
+TEST(scan, matches_partial_sum) {
+	std::mt19937_64    rng(8);
+	std::vector<int32> counts(5000);
+	for (auto &e: counts) { e = int32(rng() % 1000) - 300; }
+	std::vector<int64> inclusive(counts.size()), exclusive(counts.size());
+	int64              acc = 5;
+	for (uint64 i = 0; i < counts.size(); i++) {
+		exclusive[i] = acc;
+		acc += counts[i];
+		inclusive[i] = acc;
+	}
+	const auto source = it::iterator(counts.data(), counts.size());
+
+	// Lazy, element by element and in blocks.
+	const auto running = source | it::scan(int64(5));
+	ASSERT_EQ(running.count(), counts.size());
+	std::vector<int64> lazy;
+	for (const auto e: running) { lazy.push_back(e); }
+	ASSERT_EQ(lazy, inclusive);
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(running), inclusive);
+	const auto maxima = it::scan(source, int32(-1000), [](int32 a, int32 b) { return std::max(a, b); });
+	std::vector<int32> expected_maxima(counts.size());
+	std::partial_sum(counts.begin(), counts.end(), expected_maxima.begin(), [](int32 a, int32 b) { return std::max(a, b); });
+	ASSERT_EQ(algo::to_array<std::vector<int32>>(maxima), expected_maxima);
+
+	// Into memory, widened and in the same type, which take different vector widths.
+	std::vector<int64> out(counts.size());
+	auto               result = algo::inclusive_scan_into(source, out.data(), int64(5));
+	ASSERT_EQ(out, inclusive);
+	ASSERT_EQ(result.count, counts.size());
+	ASSERT_EQ(result.total, acc);
+	result = source | algo::exclusive_scan_into(out.data(), int64(5));
+	ASSERT_EQ(out, exclusive);
+	ASSERT_EQ(result.total, acc);
+	std::vector<int32> narrow(counts.size()), expected_narrow(counts.size());
+	std::partial_sum(counts.begin(), counts.end(), expected_narrow.begin());
+	ASSERT_EQ(algo::inclusive_scan_into(source, narrow.data()).total, expected_narrow.back());
+	ASSERT_EQ(narrow, expected_narrow);
+
+	// Without blocks, a custom operation and floats.
+	const auto positive = source | it::filter([](int32 e) { return e > 0; });
+	std::vector<int64> positive_sums;
+	for (int64 sum = 0; const auto e: counts) {
+		if (e > 0) { positive_sums.push_back(sum += e); }
+	}
+	std::vector<int64> filtered(counts.size());
+	ASSERT_EQ(algo::inclusive_scan_into(positive, filtered.data()).count, positive_sums.size());
+	filtered.resize(positive_sums.size());
+	ASSERT_EQ(filtered, positive_sums);
+	std::vector<double> halves(counts.size());
+	algo::exclusive_scan_into(source, halves.data(), 1.0, [](double a, int32 b) { return a + b / 2.0; });
+	ASSERT_EQ(halves[0], 1.0);
+	ASSERT_EQ(halves[3], 1.0 + counts[0] / 2.0 + counts[1] / 2.0 + counts[2] / 2.0);
+
+	// Two passes on several threads, the chunks have to line up with the serial result.
+	for (const uint64 threads: {1, 3}) {
+		std::fill(out.begin(), out.end(), 0);
+		result = algo::parallel_inclusive_scan_into(source, out.data(), int64(5), it::_i_plus(), threads);
+		ASSERT_EQ(out, inclusive);
+		ASSERT_EQ(result.total, acc);
+		result = algo::parallel_exclusive_scan_into(source, out.data(), int64(5), it::_i_plus(), threads);
+		ASSERT_EQ(out, exclusive);
+		ASSERT_EQ(result.count, counts.size());
+		std::vector<int32> parallel_maxima(counts.size());
+		algo::parallel_inclusive_scan_into(source, parallel_maxima.data(), int32(-1000),
+										   [](int32 a, int32 b) { return std::max(a, b); }, threads);
+		ASSERT_EQ(parallel_maxima, expected_maxima);
+	}
+	ASSERT_EQ(algo::exclusive_scan_into(it::iterator(counts.data(), uint64(0)), out.data(), int64(3)).total, 3);
+}
+
+TEST(fusion, same_results) {
+	std::vector<int> v(200);
+	for (uint64 i = 0; i < v.size(); i++) { v[i] = int(i * 7 % 23); }
+	const auto it = it::iterator(v.data(), v.size());
+
+	const auto even  = [](int e) { return e % 2 == 0; };
+	const auto small = [](int e) { return e < 15; };
+	const auto twice = [](int e) { return e * 2; };
+	const auto inc   = [](int e) { return int64(e) + 1; };
+
+	const auto filters = it | it::filter(even) | it::filter(small);
+	static_assert(std::is_same_v<decltype(filters._it), std::decay_t<decltype(it)>>);
+	ASSERT_EQ(algo::to_array<std::vector<int>>(filters),
+			  algo::to_array<std::vector<int>>(
+					  it::_i_FilterIterator(it::_i_FilterIterator(it, even), small)));
+
+	const auto maps = it | it::map(twice) | it::map(inc);
+	static_assert(std::is_same_v<decltype(maps._it), std::decay_t<decltype(it)>>);
+	static_assert(std::is_same_v<decltype(maps)::value_type, int64>);
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(maps),
+			  algo::to_array<std::vector<int64>>(it::_i_MapIterator<decltype(it::map(it, twice)),
+																	decltype(inc), int64>(
+					  it::map(it, twice), inc)));
+
+	uint64     calls  = 0;
+	const auto mapped = [&calls](int e) {
+		calls++;
+		return e * 3;
+	};
+	const auto fused = it | it::map(mapped) | it::filter(even) | it::filter(small);
+	static_assert(std::is_same_v<decltype(fused._it), std::decay_t<decltype(it)>>);
+	std::vector<int> expected;
+	for (int e: v) {
+		if (even(e * 3) && small(e * 3)) { expected.push_back(e * 3); }
+	}
+	ASSERT_EQ(algo::to_array<std::vector<int>>(fused), expected);
+
+	calls = 0;
+	for (auto mf = it::sequence_generator(0, 10) | it::map(mapped) | it::filter(even); mf.has_next();
+		 ++mf) {
+		ASSERT_EQ(*mf % 6, 0);
+	}
+	ASSERT_EQ(calls, 10);
+
+	ASSERT_EQ(algo::count(fused), algo::count(fused | it::reverse()));
+
+	// The selection path over cross_product blocks against a scalar walk.
+	const auto pairs = it::cross_product(it::iterator(v.data(), 30), it)
+			   | it::map([](auto p) { return int64(p.first) * p.second; })
+			   | it::filter([](int64 e) { return e > 100; }) | it::filter(even);
+	const uint64 selected = algo::count(pairs);
+	uint64       walked   = 0;
+	for (auto walk = pairs; walk.has_next(); ++walk) { walked += *walk > 100 && *walk % 2 == 0; }
+	ASSERT_EQ(selected, walked);
+	expect_split_matches(pairs);
+	ASSERT_EQ(it | it::filter(even) | it::filter(small) | algo::count(),
+			  it | it::filter(small) | it::filter(even) | algo::count());
+	expect_split_matches(fused);
+}
+
+TEST(prefetch, gather_matches_map) {
+	std::vector<int64>  base(1000);
+	std::vector<uint32> indices(3000);
+	for (uint64 i = 0; i < base.size(); i++) { base[i] = int64(i * i % 997); }
+	for (uint64 i = 0; i < indices.size(); i++) { indices[i] = uint32(i * 7919 % base.size()); }
+	const auto source = it::iterator(indices.data(), indices.size());
+	const auto load   = [&base](uint32 i) { return base[i]; };
+	const auto odd    = [](uint32 i) { return i % 2 == 1; };
+
+	const auto expected = algo::to_array<std::vector<int64>>(source | it::map(load));
+	for (const uint64 distance: {1, 5, 64, 5000}) {
+		ASSERT_EQ(algo::to_array<std::vector<int64>>(source | it::gather(base.data(), distance)),
+				  expected);
+
+		// Element by element, and a source without random access, which runs a copy ahead.
+		std::vector<int64> stepped;
+		for (auto g = source | it::gather(base.data(), distance); g.has_next(); ++g) {
+			stepped.push_back(*g);
+		}
+		ASSERT_EQ(stepped, expected);
+		ASSERT_EQ(algo::sum<int64>(source | it::filter(odd) | it::gather(base.data(), distance)),
+				  algo::sum<int64>(source | it::filter(odd) | it::map(load)));
+	}
+
+	// The map is fused into the prefetching adapter.
+	const auto gathered = source | it::gather<32>(base.data());
+	static_assert(std::is_same_v<decltype(gathered._it), std::decay_t<decltype(source)>>);
+	ASSERT_EQ(gathered.count(), indices.size());
+	ASSERT_EQ(gathered.peek(7), expected[7]);
+	auto skipped = gathered;
+	skipped += 100;
+	ASSERT_EQ(*skipped, expected[100]);
+	ASSERT_EQ(algo::parallel_sum<int64>(gathered, 3),
+			  algo::sum<int64>(it::iterator(expected.data(), expected.size())));
+
+	const auto passed = source | it::prefetch([&base](uint32 i) { return &base[i]; });
+	ASSERT_EQ(algo::to_array<std::vector<uint32>>(passed), indices);
+	ASSERT_EQ(algo::to_array<std::vector<int64>>(passed | it::map(load)), expected);
+}
 
 template<uint64 size>
 constexpr auto successors(array<uint8, size> conf) {
@@ -373,6 +1634,101 @@ auto backtrack(array<uint8, size> conf) {
 }
 
 
+TEST(flat_map, lazy_concatenation) {
+	const auto ranges = it::sequence_generator(0, 6)
+					  | it::flat_map([](int i) { return it::sequence_generator(10 * i, 10 * i + i % 3); });
+	const std::vector<int> expected = {10, 20, 21, 40, 50, 51};
+	ASSERT_EQ(algo::to_array<std::vector<int>>(ranges), expected);
+	ASSERT_EQ(ranges.count(), expected.size());
+	std::vector<int> walked;
+	for (auto e: ranges) { walked.push_back(e); }
+	ASSERT_EQ(walked, expected);
+
+	// The blocks of array iterators point into the iterator, which is destroyed after its last block.
+	const auto arrays = it::sequence_generator<uint8>(0, 4)
+					  | it::map([](uint8 i) { return uint8(i + 10) + (uint8(i + 10) + array<uint8, 1>(i)); })
+					  | it::flat_map([](array<uint8, 3> a) { return a.to_owning_iterator(); });
+	ASSERT_EQ(algo::count(arrays), 12);
+	const std::vector<uint8> bytes = {10, 10, 0, 11, 11, 1, 12, 12, 2, 13, 13, 3};
+	ASSERT_EQ(algo::to_array<std::vector<uint8>>(arrays), bytes);
+
+	int                           values[] = {1, 2, 3, 4, 5, 6};
+	std::vector<it::iterator<int>> nested   = {{values, 2}, {values + 2, uint64(0)}, {values + 2, 1},
+											   {values + 3, uint64(0)}, {values + 3, 3}};
+	const auto                    rows     = it::iterator(nested.data(), nested.size());
+	ASSERT_EQ(algo::sum(rows | it::flatten()), 21);
+	ASSERT_EQ(algo::count(rows | it::flatten() | it::filter([](int e) { return e % 2 == 0; })), 3);
+	ASSERT_FALSE((it::take(rows, 0) | it::flatten()).has_next());
+
+	// count() calls the lambda again, to_array doesn't reserve with it
+	uint64     calls  = 0;
+	const auto singles = it::sequence_generator(0, 1000) | it::flat_map([&calls](int i) {
+							 calls++;
+							 return it::sequence_generator(i, i + 1);
+						 })
+					   | it::map([](int i) { return 2 * i; });
+	static_assert(it::CostlyCount<decltype(singles)> && !it::CheapCountingIterator<decltype(singles)>);
+	ASSERT_EQ(algo::to_array<std::vector<int>>(singles).size(), 1000);
+	ASSERT_EQ(calls, 1000);
+	ASSERT_EQ(algo::count(singles), 1000);
+}
+
+template<uint64 size>
+auto backtrack_lazy(array<uint8, size> conf) {
+	if constexpr (size == 8) {
+		return it::single_element_iterator(conf);
+	} else {
+		return successors(conf)                       //
+			 | it::filter(legal<size + 1>)            //
+			 | it::flat_map(backtrack_lazy<size + 1>);
+	}
+}
+
+using queens = packed_array<4, 8>;
+
+// The new queen against all others at once, it threatens row, row + d and row - d at distance d.
+constexpr bool legal_packed(queens conf) {
+	if (conf.size <= 1) { return true; }
+	const auto [head, tail] = conf.head_tail();
+	const auto row          = queens::broadcast(head);
+	const auto distance     = queens::iota(1);
+	return (tail.equal(row) | tail.equal(queens::add(row, distance)) | tail.equal(queens::sub(row, distance)))
+		== 0;
+}
+
+template<uint64 size>
+auto backtrack_packed(queens conf) {
+	if constexpr (size == 8) {
+		return it::single_element_iterator(conf);
+	} else {
+		return it::sequence_generator<uint8>(0, 8)                     //
+			 | it::map([conf](uint8 i) { return conf.push_front(i); }) //
+			 | it::filter(legal_packed)                                //
+			 | it::flat_map(backtrack_packed<size + 1>);
+	}
+}
+
+TEST(backracking, queen_packed) {
+	ASSERT_EQ(algo::count(backtrack_packed<0>(queens())), 92);
+	const auto eager = backtrack(array<uint8, 0>{});
+	uint64     i     = 0;
+	for (const auto conf: backtrack_packed<0>(queens())) {
+		for (uint64 j = 0; j < 8; j++) { ASSERT_EQ(conf[j], eager[i][j]); }
+		i++;
+	}
+	ASSERT_EQ(i, eager.size());
+}
+
+TEST(backracking, queen_lazy) {
+	ASSERT_EQ(algo::count(backtrack_lazy(array<uint8, 0>{})), 92);
+	const auto eager = backtrack(array<uint8, 0>{});
+	uint64     i     = 0;
+	for (const auto conf: backtrack_lazy(array<uint8, 0>{})) {
+		ASSERT_EQ(std::memcmp(&conf, &eager[i++], sizeof(conf)), 0);
+	}
+	ASSERT_EQ(i, eager.size());
+}
+
 TEST(backracking, queen) {
 	auto solutions = backtrack(array<uint8, 0>{});
 	ASSERT_EQ(solutions.size(), 92);